@@ -0,0 +1,274 @@
+#define NOBPP_IMPLEMENTATION
+#include "../nobpp.hpp"
+
+// Measures what nobpp itself costs on generated projects. stub-compiler.cpp stands in for the compiler
+// and linker, so what is left is nobpp's own work: checking what is up to date, building commands,
+// scheduling them and starting processes. For each tree size it times
+//   - a full build, a no-op build (also through a BuildGraph), and the rebuilds after editing one source
+//     and one header that a few hundred sources include
+//   - building the compile commands and the link command, and running empty jobs on DefaultJobPool
+// The builds run in child processes, so they pay for starting up and loading the build log like a real
+// build does. The results are written as JSON to results.json next to this file (or -out=file).
+//
+//   g++ -std=c++17 -O2 benchmark-build.cpp -o benchmark-build -pthread && ./benchmark-build -sizes=1000,10000,50000
+//
+// -depth=N sets the length of the header include chains (20), -repeat=N how many no-op builds to take
+// the fastest of (3), and -label=text is stored with the results (the nobpp version being measured, say).
+
+#include <iostream>
+
+namespace
+{
+    std::filesystem::path Here()
+    {
+        return nob::ThisExecutablePath.parent_path().lexically_normal();
+    }
+
+    std::string Option(const std::string& name, const std::string& fallback)
+    {
+        for (const std::string& arg : nob::OtherCLArguments)
+        {
+            if (arg.rfind("-" + name + "=", 0) == 0) return arg.substr(name.size() + 2);
+        }
+        return fallback;
+    }
+
+    std::filesystem::path StubPath()  // named so that nobpp passes it long command lines in response files
+    {
+#if defined(__nob_msvc__)
+        return Here() / "stub-cl.exe";
+#elif defined(_WIN32)
+        return Here() / "stub-c++.exe";
+#else
+        return Here() / "stub-c++";
+#endif
+    }
+
+    nob::CompileCommand StubCompileCommand(const std::filesystem::path& tree)
+    {
+#if defined(__nob_msvc__)
+        nob::CompileCommand cmd{ nob::Command{ "\"" + StubPath().string() + "\" -c -nologo", tree } };
+#else
+        nob::CompileCommand cmd{ nob::Command{ "\"" + StubPath().string() + "\" -c", tree } };
+#endif
+        return cmd + nob::IncludeDirectory{ tree / "include" };
+    }
+
+    nob::LinkCommand StubLinkCommand(const std::filesystem::path& tree)
+    {
+#if defined(__nob_msvc__)
+        return nob::LinkCommand{ nob::Command{ "\"" + StubPath().string() + "\" -nologo -link", tree } };
+#else
+        return nob::LinkCommand{ nob::Command{ "\"" + StubPath().string() + "\"", tree } };
+#endif
+    }
+
+    // what the child processes run
+    int BuildTree(const std::filesystem::path& tree, bool graph)
+    {
+        nob::DefaultBuildLog.file = tree / ".nobpplog";
+        nob::CompileCommand compile = StubCompileCommand(tree);
+        nob::LinkCommand link = StubLinkCommand(tree);
+        if (graph)
+        {
+            nob::BuildGraph build;
+            nob::CompileDirectory(build, tree / "src", tree / "obj", compile);
+            nob::LinkDirectory(build, tree / "obj", tree / "bin" / "app", link);
+            return build.Run();
+        }
+        int ret = nob::CompileDirectory(tree / "src", tree / "obj", compile, true);
+        return ret != 0 ? ret : nob::LinkDirectory(tree / "obj", tree / "bin" / "app", link);
+    }
+
+    double TimeBuild(const std::filesystem::path& tree, const std::string& mode)  // in seconds, or -1 if it failed
+    {
+        // Init renames a new executable after the script, without updating ThisExecutablePath
+#ifdef _WIN32
+        std::filesystem::path self = Here() / "benchmark-build.exe";
+#else
+        std::filesystem::path self = Here() / "benchmark-build";
+#endif
+        nob::ProcessResult result = nob::RunProcess({ self.string(), "-norebuild", "-j" + std::to_string(nob::JobCount), mode, tree.string() });
+        if (result.exitCode != 0)
+        {
+            nob::Log("The " + mode + " of " + tree.string() + " failed:\n" + result.output + result.errors, nob::LogType::Error);
+            return -1.0;
+        }
+        return result.seconds;
+    }
+
+    double Seconds(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    struct Tree
+    {
+        size_t sources = 0;
+        size_t headers = 0;
+        size_t depth = 0;
+        size_t headerDependents = 0;  // the sources that include the edited header
+        std::vector<std::filesystem::path> files;
+    };
+
+    // The headers form chains of depth, each including the next, and every source includes two headers
+    // picked from all of them. Sources are in groups of 100 under src/module_N, so objects are nested too.
+    Tree Generate(const std::filesystem::path& root, size_t sources, size_t depth)
+    {
+        Tree tree;
+        tree.sources = sources;
+        tree.headers = std::max<size_t>(sources / 10, depth);
+        tree.depth = depth;
+        std::filesystem::remove_all(root);
+        std::filesystem::create_directories(root / "include");
+        std::filesystem::create_directories(root / "bin");
+
+        for (size_t h = 0; h < tree.headers; h++)
+        {
+            std::string name = "header_" + std::to_string(h);
+            std::ofstream out(root / "include" / (name + ".h"), std::ios::binary);
+            out << "#pragma once\n";
+            if ((h + 1) % depth != 0 && h + 1 < tree.headers) out << "#include \"header_" << h + 1 << ".h\"\n";
+            out << "\nconstexpr int " << name << "_value = " << h << ";\n";
+        }
+
+        for (size_t s = 0; s < sources; s++)
+        {
+            std::filesystem::path directory = root / "src" / ("module_" + std::to_string(s / 100));
+            if (s % 100 == 0) std::filesystem::create_directories(directory);
+
+            size_t a = (s * 7919) % tree.headers;
+            size_t b = (s * 104729 + 13) % tree.headers;
+            if (a < depth || b < depth) tree.headerDependents++;  // the first chain, which ends in the edited header
+
+            std::filesystem::path file = directory / ("source_" + std::to_string(s) + ".cpp");
+            std::ofstream out(file, std::ios::binary);
+            out << "#include \"header_" << a << ".h\"\n#include \"header_" << b << ".h\"\n\n"
+                << "int function_" << s << "() { return header_" << a << "_value + header_" << b << "_value; }\n";
+            tree.files.push_back(file);
+        }
+        return tree;
+    }
+
+    void Edit(const std::filesystem::path& file)
+    {
+        std::ofstream(file, std::ios::binary | std::ios::app) << "// edited\n";
+    }
+
+    std::string JsonEscape(const std::string& text)
+    {
+        std::string ret;
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\') ret += '\\';
+            if ((unsigned char)c >= 0x20) ret += c;
+        }
+        return ret;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    nob::Init nobInit(argc, argv, __FILE__);
+
+    if (nob::OtherCLArguments.size() == 2 && (nob::OtherCLArguments[0] == "build" || nob::OtherCLArguments[0] == "graph"))
+    {
+        return BuildTree(nob::OtherCLArguments[1], nob::OtherCLArguments[0] == "graph");
+    }
+
+    std::vector<size_t> sizes;
+    std::string list = Option("sizes", "1000,10000,50000");
+    for (size_t start = 0; start < list.size();)
+    {
+        size_t end = std::min(list.find(',', start), list.size());
+        sizes.push_back(std::strtoull(list.substr(start, end - start).c_str(), nullptr, 10));
+        start = end + 1;
+    }
+    size_t depth = std::max<size_t>(std::strtoull(Option("depth", "20").c_str(), nullptr, 10), 1);
+    int repeat = std::max(std::atoi(Option("repeat", "3").c_str()), 1);
+    std::filesystem::path out = Option("out", (Here() / "results.json").string());
+
+    nob::CompileCommand stub = nob::CompileCommand() + nob::SourceFile{ Here() / "stub-compiler.cpp" } + nob::CompilerFlag::CPPVersion17
+        + nob::CompilerFlag::OptimizeSpeed + nob::AddLinkCommand{ nob::LinkCommand() + nob::ExecutableFile{ StubPath() } };
+    if (stub.Run() != 0)
+    {
+        nob::Log("Could not build the stub compiler.\n", nob::LogType::Error);
+        return 1;
+    }
+
+    std::string json = "{\n  \"label\": \"" + JsonEscape(Option("label", "")) + "\",\n  \"timestamp\": "
+        + std::to_string(std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count())
+        + ",\n  \"jobs\": " + std::to_string(nob::JobCount) + ",\n  \"trees\": [";
+
+    for (size_t i = 0; i < sizes.size(); i++)
+    {
+        std::filesystem::path root = Here() / "trees" / ("sources_" + std::to_string(sizes[i]));
+        nob::Log("Generating " + std::to_string(sizes[i]) + " sources in " + root.string() + "\n", nob::LogType::Info);
+        auto start = std::chrono::steady_clock::now();
+        Tree tree = Generate(root, sizes[i], depth);
+        double generate = Seconds(start);
+
+        double full = TimeBuild(root, "build");
+        double noop = DBL_MAX;
+        double noopGraph = DBL_MAX;
+        for (int r = 0; r < repeat; r++)
+        {
+            noop = std::min(noop, TimeBuild(root, "build"));
+            noopGraph = std::min(noopGraph, TimeBuild(root, "graph"));
+        }
+        Edit(tree.files[tree.files.size() / 2]);
+        double editSource = TimeBuild(root, "build");
+        Edit(root / "include" / ("header_" + std::to_string(depth - 1) + ".h"));  // the end of the first chain
+        double editHeader = TimeBuild(root, "build");
+
+        // the commands CompileDirectory and LinkDirectory would make, timed without running them
+        nob::CompileCommand base = StubCompileCommand(root);
+        start = std::chrono::steady_clock::now();
+        for (const std::filesystem::path& file : tree.files)
+        {
+            std::filesystem::path object = root / "obj" / file.lexically_relative(root / "src");
+            nob::CompileCommand cmd = base + nob::SourceFile{ file } + nob::ObjectFile{ object += ".obj" };
+        }
+        double compileCommands = Seconds(start);
+
+        nob::LinkCommand link = StubLinkCommand(root);
+        start = std::chrono::steady_clock::now();
+        for (const std::filesystem::path& file : tree.files)
+        {
+            std::filesystem::path object = root / "obj" / file.lexically_relative(root / "src");
+            link += nob::ObjectFile{ object += ".obj" };
+        }
+        link += nob::ExecutableFile{ root / "bin" / "app" };
+        double linkCommand = Seconds(start);
+
+        start = std::chrono::steady_clock::now();
+        for (size_t j = 0; j < tree.sources; j++)
+        {
+            nob::DefaultJobPool.Submit([]() { return 0; });
+        }
+        nob::DefaultJobPool.Wait();
+        double jobs = Seconds(start);
+
+        char buffer[1024];
+        std::snprintf(buffer, sizeof(buffer),
+            "%s\n    {\n      \"sources\": %zu,\n      \"headers\": %zu,\n      \"depth\": %zu,\n      \"header_dependents\": %zu,\n"
+            "      \"generate_seconds\": %.6f,\n      \"full_build_seconds\": %.6f,\n      \"noop_build_seconds\": %.6f,\n"
+            "      \"noop_graph_build_seconds\": %.6f,\n      \"edit_source_seconds\": %.6f,\n      \"edit_header_seconds\": %.6f,\n"
+            "      \"compile_command_us\": %.3f,\n      \"link_command_seconds\": %.6f,\n      \"link_line_bytes\": %zu,\n"
+            "      \"pool_job_us\": %.3f\n    }",
+            i == 0 ? "" : ",", tree.sources, tree.headers, tree.depth, tree.headerDependents,
+            generate, full, noop, noopGraph, editSource, editHeader,
+            compileCommands / tree.sources * 1e6, linkCommand, link.text.size(),
+            jobs / tree.sources * 1e6);
+        json += buffer;
+
+        nob::Log(std::to_string(tree.sources) + " sources: full " + std::to_string(full) + "s, no-op " + std::to_string(noop) + "s (graph "
+            + std::to_string(noopGraph) + "s), one source " + std::to_string(editSource) + "s, one header (" + std::to_string(tree.headerDependents)
+            + " sources) " + std::to_string(editHeader) + "s\n", nob::LogType::Info);
+    }
+
+    json += "\n  ]\n}\n";
+    std::ofstream(out, std::ios::binary) << json;
+    nob::Log("Results written to " + out.string() + "\n", nob::LogType::Info);
+    return 0;
+}
@@ -0,0 +1,181 @@
+// A stand-in for the compiler and linker, so the benchmarks time nobpp rather than code generation.
+// It takes the arguments GCC, Clang or cl would, follows #include "..." through the -I directories
+// to write the .d file (or -showIncludes notes), and writes objects whose content is a hash of the
+// source and everything it includes, so an edit changes the object and a touch does not.
+// Built by benchmark-build.cpp; it has to be named like a compiler for nobpp to give it response files.
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace
+{
+    std::string ReadFile(const std::filesystem::path& file)
+    {
+        std::ifstream in(file, std::ios::binary);
+        return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    }
+
+    uint64_t Hash(const std::string& data, uint64_t hash)  // FNV-1a
+    {
+        for (unsigned char c : data)
+        {
+            hash ^= c;
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    // the lines of an @file that nobpp wrote, one quoted argument each
+    void ReadResponseFile(const std::filesystem::path& file, std::vector<std::string>& args)
+    {
+        std::ifstream in(file, std::ios::binary);
+        std::string line;
+        while (std::getline(in, line))
+        {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (line.size() >= 2 && line.front() == '"' && line.back() == '"') line = line.substr(1, line.size() - 2);
+            std::string arg;
+            for (size_t i = 0; i < line.size(); i++)
+            {
+            #ifdef _MSC_VER
+                if (line[i] == '\\' && i + 1 < line.size() && line[i + 1] == '"') i++;  // only quotes are escaped for cl
+            #else
+                if (line[i] == '\\' && i + 1 < line.size()) i++;
+            #endif
+                arg += line[i];
+            }
+            if (!arg.empty()) args.push_back(arg);
+        }
+    }
+
+    struct Compile
+    {
+        std::vector<std::filesystem::path> includeDirectories;
+        std::unordered_set<std::string> included;
+        std::vector<std::filesystem::path> headers;
+        uint64_t hash = 14695981039346656037ull;
+
+        void Read(const std::filesystem::path& file)
+        {
+            std::string text = ReadFile(file);
+            hash = Hash(text, hash);
+            size_t start = 0;
+            while ((start = text.find("#include \"", start)) != std::string::npos)
+            {
+                start += 10;
+                size_t end = text.find('"', start);
+                if (end == std::string::npos) break;
+                std::string name = text.substr(start, end - start);
+
+                std::vector<std::filesystem::path> candidates = { file.parent_path() / name };
+                for (const std::filesystem::path& directory : includeDirectories) candidates.push_back(directory / name);
+                for (const std::filesystem::path& candidate : candidates)
+                {
+                    std::error_code ec;
+                    if (!std::filesystem::is_regular_file(candidate, ec)) continue;
+                    std::string key = std::filesystem::absolute(candidate).lexically_normal().string();
+                    if (included.insert(key).second)
+                    {
+                        headers.push_back(key);
+                        Read(key);
+                    }
+                    break;
+                }
+            }
+        }
+    };
+
+    std::string Escape(const std::string& path)  // for a make rule
+    {
+        std::string ret;
+        for (char c : path)
+        {
+            if (c == ' ') ret += '\\';
+            ret += c;
+        }
+        return ret;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; i++)
+    {
+        if (argv[i][0] == '@') ReadResponseFile(argv[i] + 1, args);
+        else args.push_back(argv[i]);
+    }
+
+    bool compile = false;
+    bool showIncludes = false;
+    std::string output;
+    std::string dependencyFile;
+    std::vector<std::filesystem::path> includeDirectories;
+    std::vector<std::string> inputs;
+    for (size_t i = 0; i < args.size(); i++)
+    {
+        const std::string& arg = args[i];
+        auto value = [&](const char* flag)
+            {
+                std::string prefix = flag;
+                if (arg == prefix && i + 1 < args.size()) return args[++i];
+                if (arg.size() > prefix.size() && arg.compare(0, prefix.size(), prefix) == 0) return arg.substr(prefix.size());
+                return std::string();
+            };
+
+        std::string found;
+        if (arg == "-c") compile = true;
+        else if (arg == "-showIncludes") showIncludes = true;
+        else if (arg == "-MF" && i + 1 < args.size()) dependencyFile = args[++i];
+        else if (!(found = value("-I")).empty()) includeDirectories.push_back(found);
+        else if (arg == "-o" && i + 1 < args.size()) output = args[++i];
+        else if (arg.compare(0, 3, "-Fo") == 0 || arg.compare(0, 3, "-Fe") == 0) output = arg.substr(3);
+        else if (arg.compare(0, 5, "-out:") == 0 || arg.compare(0, 5, "-OUT:") == 0) output = arg.substr(5);
+        else if (arg[0] != '-') inputs.push_back(arg);
+    }
+
+    if (!compile)
+    {
+        // a link: the executable only has to exist, and change when an object does
+        uint64_t hash = 14695981039346656037ull;
+        for (const std::string& input : inputs) hash = Hash(ReadFile(input), hash);
+        std::ofstream(output.empty() ? std::string("a.out") : output, std::ios::binary) << "stub executable " << hash << " of " << inputs.size() << " objects\n";
+        return 0;
+    }
+
+    for (const std::string& input : inputs)
+    {
+        Compile unit;
+        unit.includeDirectories = includeDirectories;
+        unit.Read(input);
+
+        std::filesystem::path object = output;
+        std::error_code ec;
+        if (object.empty() || std::filesystem::is_directory(object, ec) || output.back() == '/' || output.back() == '\\')
+        {
+            object = object / std::filesystem::path(input).filename().replace_extension(".obj");  // a cl batch
+        }
+        std::ofstream(object, std::ios::binary) << "stub object " << unit.hash << "\n";
+
+        if (showIncludes)
+        {
+            std::cout << std::filesystem::path(input).filename().string() << "\n";
+            for (const std::filesystem::path& header : unit.headers) std::cout << "Note: including file: " << header.string() << "\n";
+        }
+        else if (!dependencyFile.empty())
+        {
+            std::ofstream deps(dependencyFile, std::ios::binary);
+            deps << Escape(object.string()) << ": " << Escape(input);
+            for (const std::filesystem::path& header : unit.headers) deps << " \\\n " << Escape(header.string());
+            deps << "\n";
+        }
+    }
+    return 0;
+}
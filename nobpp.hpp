@@ -19,7 +19,17 @@
 *   nob::Init(argv, argc, __FILE__);
 * 
 * This line will rebuild the binary if the source file has been edited since the last compile.
+* The nobpp implementation is compiled once into .nobpp/ next to the binary, so these rebuilds
+* only compile your build.cpp (NOBPP_PREBUILT_IMPLEMENTATION is defined while they do).
 * It also initialises some default commands, if flags like -debug or -silent are supplied.
+* Commands run in parallel (with CompileDirectory's runAsync, nob::DefaultJobPool or nob::BuildGraph)
+* are limited to -j N at a time, which defaults to the number of hardware threads. After a command
+* fails no more are started (-k N allows N failures, -k 0 never stops, -killonfailure also terminates
+* the running ones), and Ctrl+C stops the commands nobpp started. The output of each command is
+* printed in one piece when it finishes, under a status line like [312/1800] compiling foo.cpp. A BuildGraph
+* orders its commands by the files they read and write, so link and archive steps can start as soon
+* as their own objects are built. Wrapping the build in nob::Watch and running with -watch keeps
+* the process alive and rebuilds whenever a source (or build.cpp itself) is saved.
 * 
 * nobpp.hpp consists of two 'layers' of functionality. The first uses the struct nob::Command
 * to execute commands. Arguments are passed to these commands with overloads of the + operator
@@ -49,18 +59,79 @@
 #include <filesystem>
 #include <functional>
 #include <bitset>
+#include <cfloat>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <future>
+#include <condition_variable>
+#include <unordered_map>
+#include <unordered_set>
+#include <fstream>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <chrono>
+#include <type_traits>
 
 namespace nob
 {
+    struct ProcessResult
+    {
+        int exitCode = 0;
+        std::string output;  // everything the process wrote to stdout
+        std::string errors;  // everything the process wrote to stderr
+        double seconds = 0.0;  // wall time
+        uint64_t peakMemory = 0;  // peak resident bytes of the process (and the processes it waited for)
+        bool skipped = false;  // the command was up to date, so nothing was run
+    };
+
+    // Starts the program named by args[0] (searched for in PATH) directly, without a shell. Unless
+    // inheritOutput is set, stdout and stderr are read through pipes into the result. Arguments longer
+    // than NOBPP_RESPONSE_FILE_THRESHOLD are passed through an @response file to compilers, linkers
+    // and archivers that read them.
+    ProcessResult RunProcess(std::vector<std::string> args, std::filesystem::path workingDirectory = std::filesystem::current_path(), bool inheritOutput = false);
+    std::vector<std::string> SplitArguments(std::string text);  // splits a command line the way the platform's shell/CRT would
+
+    uint64_t HashBytes(const void* data, size_t size, uint64_t seed = 0);  // XXH64
+    uint64_t HashString(const std::string& str);
+    uint64_t HashFile(const std::filesystem::path& file);  // of its content, 0 if it cannot be read
+
+    // File times are read through a cache shared by every command, so a no-op build stats each file once.
+    // Commands drop their outputs from it when they run and Watch drops the files that changed before each
+    // rebuild, so it only needs telling about files a build script writes itself while building.
+    void InvalidateFileTime(const std::filesystem::path& file);
+    void ClearFileTimeCache();
+
+    struct TrackedFile
+    {
+        std::filesystem::path path;
+        bool optional = false;  // skipOnFail: a missing file does not make the command out of date
+    };
+
+    enum class CommandKind { Other, Compile, Link, Library };
+
     struct Command
     {
         std::string text;
-        std::filesystem::path path = std::filesystem::current_path();
+        std::filesystem::path path = std::filesystem::current_path();  // working directory of the command
 
         double latestInput = 1.0;
         double earliestOutput = DBL_MAX;
 
+        std::filesystem::path dependencyFile = {};  // headers listed here (written by the compiler) are inputs too
+        std::vector<TrackedFile> inputs = {};
+        std::vector<TrackedFile> outputs = {};
+        std::filesystem::path sourceFile = {};  // the translation unit, set by + SourceFile (inputs can start with a header or profile)
+        CommandKind kind = CommandKind::Other;  // set by the constructors of CompileCommand etc.
+        uint64_t memory = 0;  // expected peak bytes while running, 0 to use the peak logged last time
+
         int Run(bool suppressOutput = false, bool plainErrors = false);
+        ProcessResult Execute(bool suppressOutput = false, bool plainErrors = false);  // same as Run, but returns the captured output
+        bool IsUpToDate();  // checks the build log (or file times, if this output was never logged)
         void UpdateInputTime(std::filesystem::path file, bool skipOnFail = false);
         void UpdateOutputTime(std::filesystem::path file, bool skipOnFail = false);
     };
@@ -72,13 +143,317 @@ namespace nob
     Command operator+(Command a, Command b);
     Command operator-(Command a, Command b);
 
+    // cmd += x is cmd = cmd + x without copying cmd, so adding N arguments stays linear
+    template<typename C, typename T, typename = std::enable_if_t<std::is_base_of_v<Command, C>>>
+    C& operator+=(C& a, T b)
+    {
+        a = std::move(a) + std::move(b);
+        return a;
+    }
+
+    extern unsigned int JobCount;  // set with -j N, defaults to the hardware concurrency
+    extern unsigned int LinkJobCount;  // set with -linkjobs N, the most link jobs at once (0 for only the JobCount limit)
+    extern uint64_t MemoryBudget;  // set with -memory MB, the bytes of jobs the pool runs at once (defaults to the RAM available at startup)
+    extern unsigned int FailureLimit;  // set with -k N, how many jobs may fail before the rest are not started (0 to keep going, defaults to 1)
+    extern bool KillOnFailure;  // set with -killonfailure, reaching FailureLimit also terminates the jobs that are running
+
+    enum class DebugInfo { Full, Split, Compressed };
+    extern DebugInfo DebugInfoMode;  // set with -debug=split or -debug=compressed, which Debug flags -debug adds to the default commands
+
+    struct RecordedFile
+    {
+        std::filesystem::path path;
+        int64_t writeTime = 0;  // raw file clock ticks, or INT64_MIN if the file did not exist
+        uint64_t contentHash = 0;  // HashFile at that time, for link and archive inputs and BMIs (0 if not hashed)
+    };
+
+    // What a command looked like the last time it successfully produced an output.
+    struct BuildRecord
+    {
+        std::string command;
+        uint64_t commandHash = 0;
+        double seconds = 0.0;
+        uint64_t peakMemory = 0;
+        int64_t outputTime = 0;  // the output's write time just after the command wrote it
+        uint64_t outputHash = 0;  // and its HashFile then, so the commands reading it need not hash it again
+        std::vector<RecordedFile> inputs;
+        std::vector<RecordedFile> dependencies;  // read from the command's dependency file after it ran
+    };
+
+    // An append-only binary file of BuildRecords keyed by output path, like ninja's .ninja_log and
+    // .ninja_deps in one. It is read once, on first use, and compacted when it holds too many stale records.
+    // Link and archive commands also record what their inputs contained, so an object that is rebuilt
+    // into the same bytes (after a comment-only edit, say) does not relink.
+    class BuildLog
+    {
+    public:
+        std::filesystem::path file;  // defaults to .nobpplog next to the build executable
+
+        bool Find(std::filesystem::path output, BuildRecord& out);
+        void Record(std::filesystem::path output, const BuildRecord& record);
+
+    private:
+        void Load();
+
+        std::unordered_map<std::string, BuildRecord> records;
+        std::ofstream stream;
+        std::mutex mutex;
+        bool loaded = false;
+    };
+
+    extern BuildLog DefaultBuildLog;
+
+    // A Chrome trace (for about://tracing or Perfetto) of every command that ran or was skipped, with
+    // one row per thread. It is written when Init is destroyed, and enabled with -trace=file.json.
+    class BuildTrace
+    {
+    public:
+        BuildTrace();
+
+        std::filesystem::path file;  // empty disables tracing
+
+        double Now();  // microseconds since the trace started
+        void Record(const Command& cmd, double start, const ProcessResult& result, bool cached = false);
+        void Write();
+
+    private:
+        struct Event
+        {
+            std::string name;
+            std::string category;
+            std::string target;
+            std::string command;
+            double start = 0.0;
+            double end = 0.0;
+            int thread = 0;
+            int exitCode = 0;
+            bool skipped = false;
+            bool cached = false;
+        };
+
+        std::vector<Event> events;
+        std::unordered_map<std::thread::id, int> threads;
+        std::mutex mutex;
+        std::chrono::steady_clock::time_point origin;
+    };
+
+    extern BuildTrace DefaultBuildTrace;
+
+    // Frontend time per header, per template and per source, merged over every compile built with
+    // CompilerFlag::TimeTrace. -timereport adds that flag in CompileDirectory; the report is written to
+    // file and summarised in the log when Init is destroyed.
+    class TimeReport
+    {
+    public:
+        std::filesystem::path file;  // defaults to time-report.txt next to the build executable
+
+        void Add(const Command& cmd, const ProcessResult& result);  // reads the compiler's timing output, if any
+        void Write();
+
+    private:
+        struct Entry
+        {
+            double seconds = 0.0;
+            size_t count = 0;
+        };
+
+        std::unordered_map<std::string, Entry> headers;
+        std::unordered_map<std::string, Entry> templates;
+        std::unordered_map<std::string, Entry> sources;
+        std::mutex mutex;
+    };
+
+    extern TimeReport DefaultTimeReport;
+
+    // The shared tier behind an ObjectCache. Both calls take a whole batch, so a backend can pipeline
+    // it over a few connections instead of paying a round trip per file.
+    struct RemoteCacheBackend
+    {
+        virtual ~RemoteCacheBackend() = default;
+        virtual std::vector<std::optional<std::string>> Get(const std::vector<std::string>& names) = 0;
+        virtual void Put(const std::vector<std::pair<std::string, std::string>>& files) = 0;
+    };
+
+    // A plain HTTP/1.1 GET/PUT server, given as http://host[:port]/prefix (for example bazel-remote,
+    // nginx with WebDAV, or an S3-compatible bucket behind a signing proxy).
+    class HttpRemoteCache : public RemoteCacheBackend
+    {
+    public:
+        HttpRemoteCache(std::string url);
+        std::vector<std::optional<std::string>> Get(const std::vector<std::string>& names) override;
+        void Put(const std::vector<std::pair<std::string, std::string>>& files) override;
+
+        std::string host;
+        std::string port = "80";
+        std::string prefix;
+
+    private:
+        struct Response { int status = 0; std::string body; };
+        std::vector<Response> Exchange(const std::vector<std::string>& requests);  // pipelined over one connection
+        std::atomic<bool> unreachable = false;
+    };
+
+    // An opt-in cache of object files, used for single-object compiles. The key is a hash of the
+    // preprocessed source, the compile command without its output paths, and the compiler's version.
+    // Objects are restored by reflink or hardlink where possible, and the least recently used entries
+    // are removed once the cache is over sizeLimit. Stored objects are uploaded to the remote tier in
+    // the background.
+    class ObjectCache
+    {
+    public:
+        ObjectCache(std::filesystem::path directory = {}, uint64_t sizeLimit = 0, std::string remoteUrl = "");
+        ~ObjectCache();
+
+        std::filesystem::path directory;  // empty disables the cache
+        uint64_t sizeLimit = 0;  // in bytes, 0 for no limit
+        std::shared_ptr<RemoteCacheBackend> remote;  // optional
+
+        bool GetKey(const Command& cmd, uint64_t& key);  // runs the preprocessor once per command text
+        bool Fetch(uint64_t key, std::filesystem::path object, std::filesystem::path dependencyFile);
+        bool Contains(uint64_t key);  // in the local directory, without asking the remote cache
+        void Store(uint64_t key, std::filesystem::path object, std::filesystem::path dependencyFile);
+        void Prefetch(const std::vector<uint64_t>& keys);  // downloads, in one batch, every key the local cache is missing
+        void Trim();  // evicts entries if anything was stored since the last trim
+        void FinishUploads();
+        void ForgetKeys();  // GetKey remembers each command's key, which is stale once a source changes
+
+    private:
+        void Upload();
+
+        std::atomic<uint64_t> storedBytes = 0;
+        std::unordered_map<std::string, uint64_t> keys;
+        std::unordered_set<uint64_t> remoteMisses;  // asked for once already this run
+        std::vector<std::pair<std::string, std::string>> uploads;
+        std::thread uploader;
+        std::mutex mutex;
+        std::condition_variable uploadsChanged;
+        bool uploading = false;
+        bool stopping = false;
+    };
+
+    extern ObjectCache DefaultObjectCache;
+
+    // Sends single-object compiles to machines running ServeRemoteCompiles, distcc-style: the source is
+    // preprocessed here, so a worker only needs the same compiler (its CompilerIdentity must match), not
+    // the headers. Workers are host:port, used in turn, and set with NOBPP_REMOTE_WORKERS or
+    // -remote=host:port,... Modules, precompiled headers, profiles, split debug info, -march=native and
+    // commands that need a shell are compiled locally, and so is anything a worker could not answer.
+    // Returned objects go into DefaultObjectCache like local ones. A remote compile still holds a job
+    // slot while it waits, so raise -j to use more workers than there are local cores. Only the code
+    // generation flags workers accept are sent (nothing that names a file, plugin or program), so a
+    // command with any other flag is compiled locally too.
+    class RemoteCompilers
+    {
+    public:
+        RemoteCompilers(std::string workers = "");  // comma separated
+
+        std::vector<std::string> workers;
+        std::string token;  // sent with every request, from the NOBPP_REMOTE_TOKEN environment variable
+
+        bool Compile(const Command& cmd, ProcessResult& result);  // false if cmd should be compiled locally
+
+    private:
+        bool Usable(const std::string& worker);
+        void Drop(const std::string& worker, const std::string& reason);
+
+        std::atomic<size_t> next = 0;
+        std::unordered_set<std::string> dropped;  // unreachable, or built with another compiler
+        std::mutex mutex;
+    };
+
+    extern RemoteCompilers DefaultRemoteCompilers;
+
+    // Compiles what RemoteCompilers send to port with compiler (by default the one DefaultCompileCommand
+    // runs), JobCount at a time on DefaultJobPool. It returns only if the port cannot be opened. It listens
+    // on address, which is loopback unless set ("" for every interface), and when the NOBPP_REMOTE_TOKEN
+    // environment variable is set it only takes requests that send the same token. Requests with flags
+    // outside the worker's list are refused.
+    int ServeRemoteCompiles(std::string port, std::string compiler = "", std::string address = "127.0.0.1");
+
     template<typename T> void ParallelForEach(std::vector<T> vec, std::function<void(T)> fn, bool runAsync = true);
 
+    // A fixed set of worker threads that run submitted jobs. At most JobCount jobs run at once, no matter
+    // how many are submitted. Queued jobs start highest priority first (then in submission order) once
+    // their memory fits in what is left of MemoryBudget, and at most LinkJobCount links run at once.
+    // Jobs submitted from inside a job are run immediately on the same thread. Once FailureLimit jobs have
+    // failed, jobs that have not started yet return Cancelled instead of running.
+    // When MAKEFLAGS names a GNU make jobserver, every job beyond the first also needs one of its tokens,
+    // so make and the builds it starts share one -j (which then replaces JobCount). Otherwise Init starts a jobserver with JobCount - 1
+    // tokens and exports it through MAKEFLAGS, which nested builds and make -j started by commands join.
+    class JobPool
+    {
+    public:
+        static constexpr int Cancelled = -2;
+
+        ~JobPool();
+
+        std::shared_future<int> Submit(std::function<int()> job, double priority = 0.0, uint64_t memory = 0, bool isLink = false);
+        std::shared_future<int> Submit(Command cmd, bool suppressOutput = false, double priority = 0.0);  // memory from EstimateMemory
+        int Wait();  // waits for every submitted job, and returns the first non-zero result (or 0)
+        bool Report(int result);  // counts a job run outside the pool towards FailureLimit, false once the pool has stopped
+        void ClearFailures();  // lets a pool that stopped at FailureLimit start jobs again
+
+    private:
+        struct Job
+        {
+            std::packaged_task<int()> task;
+            std::shared_future<int> result;
+            double priority = 0.0;
+            uint64_t memory = 0;
+            bool isLink = false;
+        };
+
+        void Work();
+        bool Fits(const Job& job);
+        void Count(int result);
+
+        std::vector<std::thread> workers;
+        std::deque<Job> queue;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable idle;
+        size_t running = 0;
+        size_t runningLinks = 0;
+        uint64_t reservedMemory = 0;
+        int result = 0;
+        unsigned int failures = 0;
+        std::atomic<bool> failed = false;  // FailureLimit was reached
+        size_t submitted = 0;  // since the pool was last idle, for the status line
+        size_t finished = 0;
+        bool stopping = false;
+    };
+
+    extern JobPool DefaultJobPool;
+
+    // Roughly how many seconds each command will take: its time in the last build (from DefaultBuildLog),
+    // or for a command that was never built, the size of its inputs at the rate of the ones that were.
+    std::vector<double> EstimateDurations(const std::vector<const Command*>& cmds);
+    uint64_t EstimateMemory(const Command& cmd);  // cmd.memory, or the peak logged for its output last time
+
+    // A set of commands that run in dependency order on DefaultJobPool. A command depends on every other
+    // command whose outputs include one of its inputs, so a library can be archived as soon as its
+    // objects are built while other targets are still compiling. Whether each command is up to date is
+    // only checked when it is about to run, after everything it depends on has finished.
+    class BuildGraph
+    {
+    public:
+        size_t Add(Command cmd);  // returns the index of the node
+        void AddDependency(size_t node, size_t dependsOn);  // for an order the input and output files do not show
+        int Run(bool suppressOutput = false);  // returns the first non-zero result, commands after a failure are not run
+
+        std::vector<Command> nodes;
+
+    private:
+        std::vector<std::pair<size_t, size_t>> extraDependencies;
+    };
+
     bool OpenFileDialog(std::filesystem::path& out, std::filesystem::path startingFolder = std::filesystem::current_path(), bool isFolder = false);
 
     std::string AddEscapes(std::string inp);
     std::string RemoveEscapes(std::string inp);
 
+    std::vector<std::filesystem::path> ParseDependencyFile(std::filesystem::path file);  // reads a Makefile-style .d file
+
     struct CompileCommand : public Command
     {
         CompileCommand(std::filesystem::path path = std::filesystem::current_path());
@@ -106,14 +481,17 @@ namespace nob
         std::string definition;
 
         template<typename T> MacroDefinition(std::string mcr, T dfn) : macro(mcr), definition(std::to_string(dfn)) {}
-        template<> MacroDefinition(std::string mcr, std::string dfn) : macro(mcr), definition(AddEscapes("\"" + dfn + "\"")) {}
-        template<> MacroDefinition(std::string mcr, const char* dfn) : macro(mcr), definition(AddEscapes("\"" + std::string(dfn) + "\"")) {}
+        MacroDefinition(std::string mcr, std::string dfn) : macro(mcr), definition(AddEscapes("\"" + dfn + "\"")) {}
+        MacroDefinition(std::string mcr, const char* dfn) : macro(mcr), definition(AddEscapes("\"" + std::string(dfn) + "\"")) {}
     };
 
     struct PrecompiledHeader;
 
+    // On GCC and Clang the header is force-included into every command the PrecompiledHeader is added
+    // to, and pch should end in .gch (GCC) or .pch (Clang). Consumers are rebuilt whenever the pch changes.
     PrecompiledHeader CreatePrecompiledHeader(CompileCommand cmd, std::filesystem::path header, std::filesystem::path pch);
     PrecompiledHeader UsePrecompiledHeader(std::filesystem::path header, std::filesystem::path pch);
+    CompileCommand PrecompiledHeaderCommand(CompileCommand cmd, std::filesystem::path header, std::filesystem::path pch);  // what CreatePrecompiledHeader runs, for a BuildGraph
 
     struct PrecompiledHeader
     {
@@ -132,18 +510,51 @@ namespace nob
     struct ExecutableFile { std::filesystem::path path; };
     struct AddLinkCommand { LinkCommand lc; };  // it is really annoying that this has to exist, but CompilerCommand + LinkCommand is ambiguous because LinkCommand casts to a path
 
+    enum class CompilerFamily { Unknown, GCC, Clang, MSVC };
+
+    // What a compiler turned out to be when it was run: its version output, version, target, and which
+    // of the flags the CompilerFlag and LinkerFlag handlers choose between it accepts. Probing runs the
+    // compiler a few times, so the result is kept in .nobppprobe next to the build executable, keyed by
+    // the compiler's path and write time, and later runs only look the compiler up on PATH.
+    struct CompilerInfo
+    {
+        std::filesystem::path path;  // the binary, empty if it was not found
+        std::string identity;  // what --version printed (the banner for cl)
+        CompilerFamily family = CompilerFamily::Unknown;
+        int major = 0, minor = 0, patch = 0;
+        std::string target;  // x86_64-pc-linux-gnu, or x64 for cl
+        std::vector<std::string> flags;  // the probed flags it accepts
+
+        bool Supports(const std::string& flag) const;
+        bool AtLeast(int major, int minor = 0) const;
+    };
+    const CompilerInfo& ProbeCompiler(const std::string& compiler);  // compiler is a name on PATH or a path
+
     enum class CompilerFlag
     {
         OptimizeSpeed, OptimizeSpace,
         KeepLinker,
         Debug,
+        DebugSplit, DebugCompressed,  // -gsplit-dwarf (a .dwo next to each object, that the link skips) or -gz. Both are -Z7 on MSVC, so parallel compiles do not share a PDB
         PositionIndependentCode,
         CPPVersion14, CPPVersion17, CPPVersion20,
         NoObjectFile,
+        TimeTrace,  // per-header and per-template frontend timing (-ftime-trace on Clang, -d1reportTime on MSVC), read by DefaultTimeReport
+        LTO, ThinLTO,  // link-time optimization, the link needs the LinkerFlag of the same name (GCC and MSVC have no ThinLTO and do their own)
     };
-    enum class LinkerFlag { OutputDynamicLibrary, Debug };
+    enum class LinkerFlag { OutputDynamicLibrary, Debug, DebugSplit, DebugCompressed, LTO, ThinLTO, Incremental };  // DebugSplit is -debug:fastlink on MSVC, ThinLTO is -LTCG:INCREMENTAL, Incremental is MSVC only
     struct CustomCompilerFlag { std::string flag; };
     struct CustomLinkerFlag { std::string flag; };
+    struct UseLinker { std::string name; };  // "mold", "lld" or "gold" with GCC and Clang, "lld" (lld-link) with MSVC. Ignored with a warning if it is not on PATH
+    bool LinkerAvailable(std::string name);  // whether UseLinker{ name } finds the linker
+    struct LTOCache { std::filesystem::path directory; };  // where a ThinLTO link keeps its code generation, so a relink redoes only the changed modules (Clang with lld)
+
+    // Profile-guided optimization: a program built with + ProfileGenerate writes profiles when it runs,
+    // and commands with + ProfileUse optimize with them. profile is the merged profile (.profdata for
+    // Clang, .pgd for MSVC, and for GCC a list of the .gcda files MergeProfiles writes next to them) and
+    // an input of every command using it, so training again rebuilds what it affects.
+    struct ProfileGenerate { std::filesystem::path profile; };
+    struct ProfileUse { std::filesystem::path profile; };
 
     CompileCommand operator+(CompileCommand a, SourceFile b);
     CompileCommand operator+(CompileCommand a, ObjectFile b);
@@ -153,6 +564,8 @@ namespace nob
     CompileCommand operator+(CompileCommand a, CompilerFlag b);
     CompileCommand operator+(CompileCommand a, CustomCompilerFlag b);
     CompileCommand operator+(CompileCommand a, AddLinkCommand b);
+    CompileCommand operator+(CompileCommand a, ProfileGenerate b);
+    CompileCommand operator+(CompileCommand a, ProfileUse b);
 
     LinkCommand operator+(LinkCommand a, ObjectFile b);
     LinkCommand operator+(LinkCommand a, StaticLibraryFile b);
@@ -160,6 +573,10 @@ namespace nob
     LinkCommand operator+(LinkCommand a, ExecutableFile b);
     LinkCommand operator+(LinkCommand a, LinkerFlag b);
     LinkCommand operator+(LinkCommand a, CustomLinkerFlag b);
+    LinkCommand operator+(LinkCommand a, UseLinker b);
+    LinkCommand operator+(LinkCommand a, LTOCache b);
+    LinkCommand operator+(LinkCommand a, ProfileGenerate b);
+    LinkCommand operator+(LinkCommand a, ProfileUse b);
 
     LibraryCommand operator+(LibraryCommand a, ObjectFile b);
     LibraryCommand operator+(LibraryCommand a, StaticLibraryFile b);
@@ -167,8 +584,52 @@ namespace nob
     extern CompileCommand DefaultCompileCommand;
     extern LinkCommand DefaultLinkCommand;
 
-    void CompileDirectory(std::filesystem::path src, std::filesystem::path obj, CompileCommand cmd = DefaultCompileCommand, bool runAsync = false);
-    void LinkDirectory(std::filesystem::path obj, std::filesystem::path exe, LinkCommand cmd = DefaultLinkCommand);
+    // These return the first non-zero exit code, and stop starting compiles once FailureLimit have failed.
+    int CompileDirectory(std::filesystem::path src, std::filesystem::path obj, CompileCommand cmd = DefaultCompileCommand, bool runAsync = false);  // runAsync submits to DefaultJobPool
+    int LinkDirectory(std::filesystem::path obj, std::filesystem::path exe, LinkCommand cmd = DefaultLinkCommand);  // the objects CompileDirectory made in obj, or every object there
+    void CompileDirectory(BuildGraph& graph, std::filesystem::path src, std::filesystem::path obj, CompileCommand cmd = DefaultCompileCommand);  // adds the compiles to graph instead
+
+    struct CompileDirectoryOptions
+    {
+        // Unity builds #include the sources into a few generated unity_*.cpp files in obj and compile
+        // those, so shared headers are parsed once per batch instead of once per source.
+        bool unity = false;
+        size_t unityBatchBytes = 256 * 1024;  // source bytes per generated file
+        bool unityByDirectory = false;  // one generated file per source directory instead
+        std::vector<std::filesystem::path> unityExclude;  // compiled on their own (file names, or paths relative to src)
+        bool unityIsolateChanged = true;  // sources edited after their batch was built are compiled on their own until -clean
+
+        std::filesystem::path precompiledHeader;  // precompiled into obj and used by every source (MSVC sources still have to #include it first)
+
+        // The sources compiled, by extension. cl compiles ".c" files as C, g++ and clang++ as C++. Each object
+        // mirrors its source's path under src (src/a/util.cpp to obj/a/util.cpp.obj), so no two collide.
+        std::vector<std::string> extensions = { ".cpp", ".cc", ".cxx" };
+
+        // Batching hands the stale sources to a few cl processes instead of starting one per source, which
+        // saves cl's startup cost. The objects are still logged and cached one by one. Only MSVC batches
+        // (GCC and Clang cannot name the objects of a multi-source compile), and the BuildGraph overload
+        // compiles one source per command.
+        bool batch = false;
+        size_t batchSize = 0;  // most sources per process, 0 to share them out evenly (runAsync) or use one /MP process
+
+        // C++20 modules: .cppm and .ixx sources are compiled as module interfaces, and each source is compiled
+        // after the interfaces it imports, whose BMIs are kept in obj. The sources are scanned for their
+        // module declarations (with clang-scan-deps or cl -scanDependencies when the text has any) and the
+        // scan is kept in obj/modules.scan. Sources using modules are never put in unity batches or batched.
+        bool modules = true;
+    };
+
+    int CompileDirectory(std::filesystem::path src, std::filesystem::path obj, CompileDirectoryOptions options, CompileCommand cmd = DefaultCompileCommand, bool runAsync = false);
+    void CompileDirectory(BuildGraph& graph, std::filesystem::path src, std::filesystem::path obj, CompileDirectoryOptions options, CompileCommand cmd = DefaultCompileCommand);
+    void LinkDirectory(BuildGraph& graph, std::filesystem::path obj, std::filesystem::path exe, LinkCommand cmd = DefaultLinkCommand);  // links the objects graph will build in obj
+
+    // The whole PGO workflow. If profile does not exist yet (or retrain is set), build gets
+    // DefaultCompileCommand and DefaultLinkCommand with ProfileGenerate added, train runs what it built,
+    // and the profiles it wrote are merged into profile. Then build gets them with ProfileUse for the
+    // optimized build. build returns its first error, and should use the same directories both times
+    // (GCC finds the profile of each object by the object's path).
+    int ProfileGuidedBuild(std::filesystem::path profile, Command train, std::function<int(CompileCommand compile, LinkCommand link, bool instrumented)> build, bool retrain = false);
+    int MergeProfiles(std::filesystem::path profile);  // what ProfileGuidedBuild does after training
 
     enum CLArgument
     {
@@ -178,6 +639,8 @@ namespace nob
         Debug,
         Silent,
         Clean,
+        ReportTime,
+        WatchMode,
         Count,
     };
 
@@ -192,6 +655,12 @@ namespace nob
         ~Init();
     };
 
+    // Runs build once, or with -watch, runs it again every time a file under one of directories changes,
+    // until the process is stopped. The build log and job pool stay in memory between runs, so a build
+    // after a save only pays for the commands that are out of date. Editing the build script rebuilds
+    // it and carries on watching in the new executable.
+    void Watch(std::vector<std::filesystem::path> directories, std::function<void()> build);
+
     enum LogType
     {
         None = -1,
@@ -200,7 +669,22 @@ namespace nob
         Error,
     };
 
+    // What Log passes on: written to stdout by a separate thread, or handed to NOBPP_CUSTOM_LOG on that
+    // thread if it is defined. It converts to the prefixed text the hook was given before it got records.
+    struct LogRecord
+    {
+        LogType type = LogType::None;
+        std::string text;
+        std::string job;  // what was running when it was logged, like "compiling foo.cpp" (empty outside a command)
+
+        operator std::string() const;
+    };
+
+    // Log returns without waiting for the output. Everything logged while a command runs is held back and
+    // written in one piece when it finishes, so the output of parallel jobs does not interleave. On a
+    // terminal, a status line under the output shows the newest running command and the pool's progress.
     void Log(std::string s, LogType t = LogType::None);
+    void FlushLog();  // writes everything this thread logged and waits for it. Call it before printing to stdout directly
 
     struct ConfigurationFile
     {
@@ -215,8 +699,13 @@ namespace nob
         bool IsSummaryMode = false;
         enum class ConfigRecompileMode { Always, Ask, Never } recompileMode = ConfigurationFile::ConfigRecompileMode::Always;
         std::string initScript = "";
+        std::string cacheDirectory = "";
+        int cacheSizeLimit = 5120;  // in megabytes
+        std::string remoteCacheUrl = "";
+        std::string linker = "";  // for UseLinker, empty for the compiler's default
 
-        CompileCommand GetCommand(SourceFile sf, ExecutableFile ef);
+        CompileCommand GetCommand(SourceFile sf, ExecutableFile ef, std::filesystem::path prebuiltImplementation = {});  // links against a prebuilt implementation object, if given
+        CompileCommand GetBaseCommand();  // the compiler, default flags and configuration macros, without any files
         static ConfigurationFile GetDefaultConfig();
     };
 
@@ -228,12 +717,45 @@ namespace nob
     std::string AskShortAnswerQuestion(std::string question);
 
     ConfigurationFile GenerateConfigFile();
+
+
+    template<typename T>
+    void ParallelForEach(std::vector<T> vec, std::function<void(T)> fn, bool runAsync)
+    {
+        if (runAsync && vec.size() > 1)
+        {
+            // at most JobCount threads, each taking the next unclaimed element
+            std::atomic<size_t> next = 0;
+            std::vector<std::thread> threads;
+            for (size_t t = 0; t < std::min<size_t>(std::max(JobCount, 1u), vec.size()); t++)
+            {
+                threads.push_back(std::thread([&]()
+                    {
+                        for (size_t i = next++; i < vec.size(); i = next++)
+                        {
+                            fn(vec[i]);
+                        }
+                    }));
+            }
+            for (std::thread& t : threads)
+            {
+                t.join();
+            }
+        }
+        else
+        {
+            for (T& i : vec)
+            {
+                fn(i);
+            }
+        }
+    }
 }
 
 #endif
 
 
-#ifdef NOBPP_IMPLEMENTATION
+#if defined(NOBPP_IMPLEMENTATION) && !defined(NOBPP_PREBUILT_IMPLEMENTATION)
 // nobpp implementation
 
 #include <thread>
@@ -243,6 +765,12 @@ namespace nob
 #include <ciso646>
 #include <cstdlib>
 #include <system_error>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <algorithm>
+#include <cstdio>
+#include <cctype>
 
 // ------------------------------ MACRO DEFINITIONS ----------------------------------
 #if defined(__clang__)
@@ -264,7 +792,11 @@ namespace nob
    || !defined(NOBPP_MINIMUM_LOG_LEVEL) \
    || !defined(NOBPP_SUMMARY_MODE) \
    || !defined(NOBPP_RECOMPILE_MODE) \
-   || !defined(NOBPP_INIT_SCRIPT)
+   || !defined(NOBPP_INIT_SCRIPT) \
+   || !defined(NOBPP_CACHE_DIRECTORY) \
+   || !defined(NOBPP_CACHE_SIZE_LIMIT) \
+   || !defined(NOBPP_REMOTE_CACHE_URL) \
+   || !defined(NOBPP_LINKER_NAME)
     #error  // poorly defined configuration
   #else
     #if (NOBPP_UI_MODE != 0 && NOBPP_UI_MODE != 1) /* basic, pretty */ \
@@ -299,159 +831,3924 @@ namespace nob
   #define NOBPP_SUMMARY_MODE 0
   #define NOBPP_RECOMPILE_MODE 1
   #define NOBPP_INIT_SCRIPT ""
+  #define NOBPP_CACHE_DIRECTORY ""  /* no object cache */
+  #define NOBPP_CACHE_SIZE_LIMIT 5120  /* megabytes */
+  #define NOBPP_REMOTE_CACHE_URL ""  /* no remote tier */
+  #define NOBPP_LINKER_NAME ""  /* the compiler's default */
 #endif
 
-#if (NOBPP_UI_MODE == 1 || NOBPP_FILE_DIALOG_MODE == 2) && defined(_WIN32)
+#if defined(_WIN32)
 #define NOMINMAX
-#include <Windows.h>  // for logging :(
+#include <winsock2.h>  // for the remote cache, and before Windows.h so it does not pull in winsock 1
+#include <ws2tcpip.h>
+#include <Windows.h>  // for processes and logging :(
+#include <psapi.h>  // for the peak memory of processes
+#if NOBPP_FILE_DIALOG_MODE == 2
 #include <shobjidl.h>  // for file dialog :(
 #endif
+#if defined(_MSC_VER)
+#pragma comment(lib, "ws2_32.lib")
+#pragma comment(lib, "psapi.lib")
+#endif
+#else
+#include <spawn.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>  // for the width of the terminal
+#if defined(__linux__)
+#include <linux/fs.h>  // for FICLONE (reflinks)
+#include <sys/inotify.h>
+#endif
+extern char** environ;
+#endif
+
+#ifndef NOBPP_MSVC_DEPS_PREFIX
+#define NOBPP_MSVC_DEPS_PREFIX "Note: including file:"  // the -showIncludes prefix, which is localized
+#endif
+
+#ifndef NOBPP_PROFILE_MERGE_TOOL
+#if defined(__nob_msvc__)
+#define NOBPP_PROFILE_MERGE_TOOL "pgomgr"
+#else
+#define NOBPP_PROFILE_MERGE_TOOL "llvm-profdata"  // GCC's .gcda files need no merging
+#endif
+#endif
+
+#ifndef NOBPP_JOBSERVER
+#define NOBPP_JOBSERVER 1  // 0 keeps the job pool out of GNU make's jobserver
+#endif
+
+#ifndef NOBPP_REMOTE_WORKERS
+#define NOBPP_REMOTE_WORKERS ""  // host:port,... of ServeRemoteCompiles workers, empty compiles locally
+#endif
+
+#ifndef NOBPP_RESPONSE_FILE_THRESHOLD
+#ifdef _WIN32
+#define NOBPP_RESPONSE_FILE_THRESHOLD 30000  // CreateProcess stops at 32767 characters
+#else
+#define NOBPP_RESPONSE_FILE_THRESHOLD 131072  // Linux also limits a single argument to 128KB
+#endif
+#endif
 
 // --------------------------- NOBPP CORE ---------------------------
 namespace nob
 {
 // --------------------------- BASIC COMMAND -----------------------------
 
-    int Command::Run(bool suppressOutput, bool plainErrors)
+    namespace
     {
-        if (!CLFlags[CLArgument::Clean] and earliestOutput != FLT_MAX and latestInput < earliestOutput)
+        struct FileTimeCache
         {
-            Log("Command skipped.\n", LogType::Run);
-            return 0;
-        }
-
-        Log("Times: " + std::to_string(latestInput) + "," + std::to_string(earliestOutput), LogType::Run);
+            std::mutex mutex;
+            std::unordered_map<std::string, std::optional<std::filesystem::file_time_type>> times;  // nullopt for a missing file
+            uint64_t generation = 0;  // counts invalidations, so a stat that raced one is not stored
+        };
 
-        if (CLFlags[CLArgument::Silent])
+        FileTimeCache& FileTimes()
         {
-            suppressOutput = true;
+            static FileTimeCache* cache = new FileTimeCache();  // leaked, so jobs still running at exit can use it
+            return *cache;
         }
 
-        Log(text, LogType::Run);
-
-        if (!suppressOutput)
+        // the same file named relatively and absolutely is one entry, so invalidating either form works
+        std::string FileTimeKey(const std::filesystem::path& file)
         {
-            Log("\n");
+            std::error_code ec;
+            return (file.is_absolute() ? file : std::filesystem::absolute(file, ec)).lexically_normal().string();
         }
 
-        int ret = std::system(
-            ("\"" + text + "\"" + (suppressOutput ?
-        #ifdef _WIN32
-            " >nul"
-        #else
-            " >/dev/null"
-        #endif            
-            : "") + (plainErrors ? std::string("") : (" 2>" + (std::filesystem::temp_directory_path() / "nob_error_log.txt").string()))).c_str()
-        );
-
-        if (!plainErrors)
+        std::optional<std::filesystem::file_time_type> CachedWriteTime(const std::filesystem::path& file)
         {
+            FileTimeCache& cache = FileTimes();
+            std::string key = FileTimeKey(file);
+            uint64_t generation = 0;
             {
-                std::ifstream errorFile((std::filesystem::temp_directory_path() / "nob_error_log.txt"));
-                std::string temp;
-                while (std::getline(errorFile, temp))
-                {
-                    Log(temp + "\n", LogType::Error);
-                }
+                std::lock_guard<std::mutex> lock(cache.mutex);
+                auto it = cache.times.find(key);
+                if (it != cache.times.end()) return it->second;
+                generation = cache.generation;
             }
-        }
-
-        Log("Done\n", LogType::Run);
 
-        return ret;
-    }
+            std::error_code ec;
+            std::filesystem::file_time_type time = std::filesystem::last_write_time(file, ec);
+            std::optional<std::filesystem::file_time_type> ret;
+            if (!ec) ret = time;
 
-    void Command::UpdateInputTime(std::filesystem::path file, bool skipOnFail)
-    {
-        if (std::filesystem::exists(file))
-        {
-            double modified = std::chrono::duration<double>(std::filesystem::last_write_time(file).time_since_epoch()).count();
-            latestInput = std::max(latestInput, modified);
+            std::lock_guard<std::mutex> lock(cache.mutex);
+            if (cache.generation == generation) cache.times[key] = ret;
+            return ret;
         }
-        else if (!skipOnFail)
+
+        // MSVC's directory_entry already holds the time FindNextFile returned, elsewhere reading it is a stat
+        // like any other, left until something asks
+        void CacheFileTime(const std::filesystem::directory_entry& entry)
         {
-            latestInput = FLT_MAX;
+#if defined(_MSVC_STL_VERSION)
+            std::error_code ec;
+            std::filesystem::file_time_type time = entry.last_write_time(ec);
+            if (ec) return;
+            FileTimeCache& cache = FileTimes();
+            std::string key = FileTimeKey(entry.path());
+            std::lock_guard<std::mutex> lock(cache.mutex);
+            cache.times.emplace(key, time);
+#else
+            (void)entry;
+#endif
         }
     }
 
-    void Command::UpdateOutputTime(std::filesystem::path file, bool skipOnFail)
+    void InvalidateFileTime(const std::filesystem::path& file)
     {
-        if (std::filesystem::exists(file))
-        {
-            double modified = std::chrono::duration<double>(std::filesystem::last_write_time(file).time_since_epoch()).count();
-            earliestOutput = std::min(earliestOutput, modified);
-        }
-        else if (!skipOnFail)
-        {
-            earliestOutput = 0.0;
-        }
+        FileTimeCache& cache = FileTimes();
+        std::string key = FileTimeKey(file);
+        std::lock_guard<std::mutex> lock(cache.mutex);
+        cache.times.erase(key);
+        cache.generation++;
     }
 
-    Command operator+(Command a, std::string b)
+    void ClearFileTimeCache()
     {
-        return Command{ a.text == "" ? b : a.text + " " + b, a.path, a.latestInput, a.earliestOutput };
+        FileTimeCache& cache = FileTimes();
+        std::lock_guard<std::mutex> lock(cache.mutex);
+        cache.times.clear();
+        cache.generation++;
     }
 
-    Command operator-(Command a, std::string b)
+    int64_t GetWriteTime(const std::filesystem::path& file)
     {
-        return Command{ a.text == "" ? b : a.text + b, a.path, a.latestInput, a.earliestOutput };
+        std::optional<std::filesystem::file_time_type> time = CachedWriteTime(file);
+        return time ? (int64_t)time->time_since_epoch().count() : INT64_MIN;
     }
 
-    Command operator+(Command a, std::filesystem::path b)
+    double FileTimeToSeconds(std::filesystem::file_time_type time)
     {
-        return a + ("\"" + b.string() + "\"");
+        // the file clock's epoch is unspecified (libstdc++ uses 2174, which makes every time negative), so
+        // shift it onto the system clock to keep times above the 0.0 and 1.0 sentinels
+        static const double offset = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count()
+            - std::chrono::duration<double>(std::filesystem::file_time_type::clock::now().time_since_epoch()).count();
+        return std::chrono::duration<double>(time.time_since_epoch()).count() + offset;
     }
 
-    Command operator-(Command a, std::filesystem::path b)
+    // the modification time of file in FileTimeToSeconds units, or missing if it does not exist
+    double WriteSeconds(const std::filesystem::path& file, double missing)
     {
-        return a - ("\"" + b.string() + "\"");
+        std::optional<std::filesystem::file_time_type> time = CachedWriteTime(file);
+        return time ? FileTimeToSeconds(*time) : missing;
     }
 
-    Command operator+(Command a, Command b)
+    int Command::Run(bool suppressOutput, bool plainErrors)
     {
-        return a + std::string("&&") + b.text;
+        return Execute(suppressOutput, plainErrors).exitCode;
     }
 
-    Command operator-(Command a, Command b)
+    bool NeedsShell(const std::string& text)
     {
-        return a + b.text;
+        bool quoted = false;
+        for (size_t i = 0; i < text.size(); i++)
+        {
+            if (text[i] == '"') quoted = !quoted;
+            else if (text[i] == '\\' && quoted) i++;
+            else if (!quoted && (text[i] == '&' || text[i] == '|' || text[i] == '<' || text[i] == '>' || text[i] == ';')) return true;
+        }
+        return false;
     }
 
-
-// ------------------------ CORE HELPER FUNCTIONS -------------------------
-
-    template<typename T>
-    void ParallelForEach(std::vector<T> vec, std::function<void(T)> fn, bool runAsync)
+    namespace
     {
-        if (runAsync)
+        void Print(const std::vector<LogRecord>& records, const std::string& before, const std::string& after)
         {
-            std::vector<std::thread> threads;
-            for (T& i : vec)
+        #ifdef NOBPP_CUSTOM_LOG
+            for (const LogRecord& record : records)
             {
-                threads.push_back(std::thread(fn, i));
+                NOBPP_CUSTOM_LOG((record));
             }
-            for (std::thread& t : threads)
+        #elif NOBPP_UI_MODE == 1 && defined(_WIN32)
+            HANDLE console = GetStdHandle(STD_OUTPUT_HANDLE);
+            std::cout << before;
+            for (size_t i = 0; i < records.size();)
             {
-                t.join();
+                // one attribute change per run of records of the same type
+                std::string text;
+                LogType type = records[i].type;
+                for (; i < records.size() && records[i].type == type; i++) text += (std::string)records[i];
+
+                int consoleCode = 15;
+                switch (type)
+                {
+                case LogType::Info: consoleCode = 3; break;
+                case LogType::Run: consoleCode = 8; break;
+                case LogType::Error: consoleCode = 4; break;
+                default:
+                    break;
+                }
+
+                std::cout.flush();
+                SetConsoleTextAttribute(console, consoleCode);
+                std::cout << text;
+                std::cout.flush();
+                SetConsoleTextAttribute(console, 15);
+            }
+            std::cout << after;
+        #elif NOBPP_UI_MODE == 1
+            std::string out = before;
+            for (const LogRecord& record : records)
+            {
+                std::string consoleCode = "0";
+                switch (record.type)
+                {
+                case LogType::Info: consoleCode = "0;36"; break;
+                case LogType::Run: consoleCode = "1;30"; break;
+                case LogType::Error: consoleCode = "0;31"; break;
+                default:
+                    break;
+                }
+                out += "\033[" + consoleCode + "m" + (std::string)record + "\033[0m";
+            }
+            std::cout << out + after;
+        #else
+            std::string out = before;
+            for (const LogRecord& record : records)
+            {
+                out += (std::string)record;
             }
+            std::cout << out + after;
+        #endif
+            std::cout.flush();
         }
-        else
+
+        size_t TerminalWidth()
         {
-            for (T& i : vec)
+        #ifdef _WIN32
+            CONSOLE_SCREEN_BUFFER_INFO info;
+            if (GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &info)) return info.srWindow.Right - info.srWindow.Left + 1;
+        #else
+            winsize size = {};
+            if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_col > 0) return size.ws_col;
+        #endif
+            return 80;
+        }
+
+        // queues what Log is given and writes it from its own thread, so a job never waits on the terminal
+        // and many small records go out in one write. It also keeps the status line under the output
+        class LogSink
+        {
+        public:
+            LogSink();
+
+            void Write(std::vector<LogRecord> records);
+            void Start(std::string job);  // a command started running
+            void Finish(const std::string& job, std::vector<LogRecord> records);  // and what it logged
+            void Progress(size_t finished, size_t submitted);  // of DefaultJobPool
+            void Flush();
+            void Close();  // at exit, after which records are written straight away
+
+        private:
+            void Run();
+            std::string StatusLine();
+
+            std::mutex mutex;
+            std::condition_variable changed;
+            std::condition_variable drained;
+            std::vector<LogRecord> queue;
+            std::vector<std::string> running;  // newest last, that one is shown
+            size_t finished = 0;
+            size_t submitted = 0;
+            bool redraw = false;
+            bool hidden = false;  // Flush took the status line down until something new is logged
+            bool writing = false;
+            bool closed = false;
+            bool terminal = false;
+
+            // only used by the writer thread
+            std::string shown;
+            bool lineStart = true;  // the status line only goes after a complete line
+        };
+
+        LogSink::LogSink()
+        {
+        #ifndef NOBPP_CUSTOM_LOG
+          #ifdef _WIN32
+            DWORD mode = 0;
+            terminal = GetConsoleMode(GetStdHandle(STD_OUTPUT_HANDLE), &mode) != 0;
+          #else
+            terminal = isatty(STDOUT_FILENO) != 0;
+          #endif
+        #endif
+            std::thread(&LogSink::Run, this).detach();
+        }
+
+        void LogSink::Write(std::vector<LogRecord> records)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (closed)
             {
-                fn(i);
+                Print(records, "", "");
+                return;
             }
+            queue.insert(queue.end(), std::make_move_iterator(records.begin()), std::make_move_iterator(records.end()));
+            hidden = false;
+            changed.notify_one();
         }
-    }
 
-    std::string AddEscapes(std::string inp)
-    {
-        std::string ret = "";
-        for (int i = 0; i < inp.size(); i++)
+        void LogSink::Start(std::string job)
         {
-            switch (inp[i])
-            {
-            case '\'': ret += "\\\'"; break;
+            std::lock_guard<std::mutex> lock(mutex);
+            running.push_back(std::move(job));
+            hidden = false;
+            redraw = true;
+            changed.notify_one();
+        }
+
+        void LogSink::Finish(const std::string& job, std::vector<LogRecord> records)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                auto it = std::find(running.rbegin(), running.rend(), job);
+                if (it != running.rend()) running.erase(std::next(it).base());
+                redraw = true;
+            }
+            Write(std::move(records));
+        }
+
+        void LogSink::Progress(size_t finishedJobs, size_t submittedJobs)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            finished = finishedJobs;
+            submitted = submittedJobs;
+            redraw = true;
+            changed.notify_one();
+        }
+
+        void LogSink::Flush()
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (closed) return;
+            hidden = true;
+            redraw = true;
+            changed.notify_one();
+            drained.wait(lock, [this]() { return queue.empty() && !redraw && !writing; });
+        }
+
+        void LogSink::Close()
+        {
+            Flush();
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+        }
+
+        std::string LogSink::StatusLine()
+        {
+            if (!terminal || hidden || running.empty()) return "";
+            std::string ret = submitted > 0 ? "[" + std::to_string(finished) + "/" + std::to_string(submitted) + "] " + running.back() : running.back();
+            size_t width = TerminalWidth();
+            if (ret.size() >= width) ret.resize(width - 1);  // \r only goes back to the start of a line that did not wrap
+            return ret;
+        }
+
+        void LogSink::Run()
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true)
+            {
+                changed.wait(lock, [this]() { return !queue.empty() || redraw; });
+                std::vector<LogRecord> records = std::move(queue);
+                queue.clear();
+                redraw = false;
+                std::string status = StatusLine();
+                writing = true;
+                lock.unlock();
+
+                for (const LogRecord& record : records)
+                {
+                    if (record.text != "") lineStart = record.text.back() == '\n';
+                }
+                if (!lineStart) status = "";
+                if (!records.empty() || status != shown)
+                {
+                    std::string erase = shown != "" ? "\r" + std::string(shown.size(), ' ') + "\r" : "";
+                    Print(records, erase, status);
+                    shown = status;
+                }
+
+                lock.lock();
+                writing = false;
+                drained.notify_all();
+            }
+        }
+
+        LogSink& Sink()
+        {
+            // never destroyed, so the destructors of other globals can still log. Exit flushes it instead
+            static LogSink* sink = []()
+                {
+                    LogSink* ret = new LogSink();
+                    std::atexit([]() { Sink().Close(); });
+                    return ret;
+                }();
+            return *sink;
+        }
+
+        // gathers what a command logs while it runs, including the commands it runs itself
+        struct LogGroup
+        {
+            std::string job;
+            std::vector<LogRecord> records;
+            bool started = false;
+        };
+        thread_local LogGroup* CurrentGroup = nullptr;
+
+        class ScopedLogGroup
+        {
+        public:
+            ScopedLogGroup(const Command& cmd) : owner(CurrentGroup == nullptr)
+            {
+                if (!owner) return;
+                group.job = Describe(cmd);
+                CurrentGroup = &group;
+            }
+
+            ~ScopedLogGroup()
+            {
+                if (!owner) return;
+                CurrentGroup = nullptr;
+                if (group.started) Sink().Finish(group.job, std::move(group.records));
+                else Sink().Write(std::move(group.records));
+            }
+
+            void Start()  // once it is not skipped, it shows on the status line
+            {
+                if (!owner) return;
+                Sink().Start(group.job);
+                group.started = true;
+            }
+
+        private:
+            static std::string Describe(const Command& cmd)
+            {
+                auto name = [](const std::filesystem::path& file) { return file.filename().string(); };
+                if (cmd.kind == CommandKind::Compile && cmd.sourceFile != "") return "compiling " + name(cmd.sourceFile);
+                if (cmd.kind == CommandKind::Compile && !cmd.inputs.empty()) return "compiling " + name(cmd.inputs[0].path);
+                if (cmd.kind == CommandKind::Link && !cmd.outputs.empty()) return "linking " + name(cmd.outputs[0].path);
+                if (cmd.kind == CommandKind::Library && !cmd.outputs.empty()) return "archiving " + name(cmd.outputs[0].path);
+                return "running " + (cmd.outputs.empty() ? cmd.text.substr(0, cmd.text.find(' ')) : name(cmd.outputs[0].path));
+            }
+
+            LogGroup group;
+            bool owner;
+        };
+    }
+
+    namespace
+    {
+        bool IsModuleFile(const std::filesystem::path& file)  // a compiled module interface (BMI)
+        {
+            std::string extension = file.extension().string();
+            return extension == ".pcm" || extension == ".ifc" || extension == ".gcm";
+        }
+
+        bool UsesModules(const Command& cmd)
+        {
+            for (const std::vector<TrackedFile>* files : { &cmd.inputs, &cmd.outputs })
+            {
+                for (const TrackedFile& file : *files)
+                {
+                    if (IsModuleFile(file.path)) return true;
+                }
+            }
+            return false;
+        }
+
+        std::atomic<uint64_t> CommandsRun = 0;  // that were not up to date, so Watch knows whether a build did anything
+
+        // taken before running, so an input edited during the build is still seen as changed next time
+        std::vector<RecordedFile> InputTimes(const Command& cmd)
+        {
+            std::vector<RecordedFile> ret;
+            for (const TrackedFile& input : cmd.inputs)
+            {
+                ret.push_back({ input.path, GetWriteTime(input.path) });
+            }
+            return ret;
+        }
+
+        // file's content when it had writeTime: the hash its command logged after writing it, or else read
+        // now (and 0 if it is not what it was at writeTime any more)
+        uint64_t ContentHash(const std::filesystem::path& file, int64_t writeTime)
+        {
+            if (writeTime == INT64_MIN) return 0;
+            BuildRecord producer;
+            if (DefaultBuildLog.Find(file, producer) && producer.outputHash != 0 && producer.outputTime == writeTime)
+            {
+                return producer.outputHash;
+            }
+            uint64_t hash = HashFile(file);
+            InvalidateFileTime(file);  // the cached time is from before hashing, and this looks for a write during it
+            return GetWriteTime(file) == writeTime ? hash : 0;
+        }
+
+        int64_t FileClockNow()
+        {
+            return (int64_t)std::filesystem::file_time_type::clock::now().time_since_epoch().count();
+        }
+
+        // started is FileClockNow() from before the command ran: a dependency written since then may have
+        // changed after the compiler read it, so it is logged as missing and compiled again next time
+        void RecordBuild(const Command& cmd, std::vector<RecordedFile> inputTimes, int64_t started, double seconds, uint64_t peakMemory)
+        {
+            std::unordered_map<std::string, int64_t> known;
+            for (const RecordedFile& input : inputTimes) known[input.path.string()] = input.writeTime;
+            BuildRecord record{ cmd.text, HashString(cmd.text), seconds, peakMemory, 0, 0, std::move(inputTimes), {} };
+            for (RecordedFile& input : record.inputs)
+            {
+                // objects and BMIs are often rebuilt into the same bytes, sources and headers hardly ever are
+                if (cmd.kind == CommandKind::Link || cmd.kind == CommandKind::Library || IsModuleFile(input.path))
+                {
+                    input.contentHash = ContentHash(input.path, input.writeTime);
+                }
+            }
+            if (cmd.dependencyFile != "" && std::filesystem::exists(cmd.dependencyFile))
+            {
+                for (std::filesystem::path& dep : ParseDependencyFile(cmd.dependencyFile))
+                {
+                    auto input = known.find(dep.string());
+                    int64_t writeTime = input != known.end() ? input->second : GetWriteTime(dep);
+                    record.dependencies.push_back({ dep, writeTime > started ? INT64_MIN : writeTime });
+                }
+            }
+            for (const TrackedFile& output : cmd.outputs)
+            {
+                // nothing reads an executable, so only what can be linked is hashed
+                record.outputTime = GetWriteTime(output.path);
+                record.outputHash = cmd.kind != CommandKind::Link && record.outputTime != INT64_MIN ? HashFile(output.path) : 0;
+                DefaultBuildLog.Record(output.path, record);
+            }
+        }
+
+    #if defined(__nob_msvc__)
+        // -showIncludes prints the headers to stdout, so move them out of output and return them as .d text
+        std::string TakeShowIncludes(std::string& output)
+        {
+            std::string rest;
+            std::string deps;
+            size_t start = 0;
+            while (start < output.size())
+            {
+                size_t end = std::min(output.find('\n', start), output.size());
+                std::string line = output.substr(start, end - start);
+                if (line.substr(0, std::strlen(NOBPP_MSVC_DEPS_PREFIX)) == NOBPP_MSVC_DEPS_PREFIX)
+                {
+                    line = line.substr(line.find_first_not_of(" ", std::strlen(NOBPP_MSVC_DEPS_PREFIX)));
+                    if (line != "" && line.back() == '\r') line.pop_back();
+                    for (char c : line)
+                    {
+                        if (c == ' ') deps += "\\ ";
+                        else deps += c;
+                    }
+                    deps += " \\\n";
+                }
+                else
+                {
+                    rest += line + "\n";
+                }
+                start = end + 1;
+            }
+            output = rest;
+            return deps;
+        }
+    #endif
+    }
+
+    ProcessResult Command::Execute(bool suppressOutput, bool plainErrors)
+    {
+        double traceStart = DefaultBuildTrace.Now();
+        ScopedLogGroup logGroup(*this);
+        if (IsUpToDate())
+        {
+            Log("Command skipped.\n", LogType::Run);
+            ProcessResult ret;
+            ret.skipped = true;
+            DefaultBuildTrace.Record(*this, traceStart, ret);
+            return ret;
+        }
+        logGroup.Start();
+        CommandsRun++;
+
+        Log("Times: " + std::to_string(latestInput) + "," + std::to_string(earliestOutput) + "\n", LogType::Run);
+
+        if (CLFlags[CLArgument::Silent])
+        {
+            suppressOutput = true;
+        }
+
+        Log(text, LogType::Run);
+
+        if (!suppressOutput)
+        {
+            Log("\n");
+        }
+
+        // chained (&&) commands and redirections still need a shell, everything else is spawned directly
+        std::vector<std::string> args = NeedsShell(text) ?
+        #ifdef _WIN32
+            std::vector<std::string>{ "cmd", "/S", "/C", "\"" + text + "\"" }
+        #else
+            std::vector<std::string>{ "/bin/sh", "-c", text }
+        #endif
+            : SplitArguments(text);
+
+        std::vector<RecordedFile> inputTimes = InputTimes(*this);
+        int64_t started = FileClockNow();
+
+        bool singleObject = kind == CommandKind::Compile && dependencyFile != "" && outputs.size() == 1 && !NeedsShell(text);
+        uint64_t cacheKey = 0;
+        bool cacheable = singleObject && DefaultObjectCache.directory != "" && DefaultObjectCache.GetKey(*this, cacheKey);
+
+        if (cacheable && DefaultObjectCache.Fetch(cacheKey, outputs[0].path, dependencyFile))
+        {
+            InvalidateFileTime(outputs[0].path);
+            Log("Restored from the object cache.\n", LogType::Run);
+            BuildRecord previous;
+            bool found = DefaultBuildLog.Find(outputs[0].path, previous);
+            RecordBuild(*this, inputTimes, started, found ? previous.seconds : 0.0, found ? previous.peakMemory : 0);  // keep the real compile time and memory
+            DefaultBuildTrace.Record(*this, traceStart, ProcessResult{}, true);
+            return ProcessResult{};
+        }
+
+        if (singleObject)
+        {
+            // the object may be a link to a cache entry, which the compiler would overwrite in place
+            std::error_code ec;
+            std::filesystem::remove(outputs[0].path, ec);
+        }
+
+        ProcessResult ret;
+        bool remote = singleObject && DefaultRemoteCompilers.Compile(*this, ret);  // which writes the .d itself
+        if (!remote) ret = RunProcess(args, path, plainErrors && !suppressOutput);
+        for (const TrackedFile& output : outputs) InvalidateFileTime(output.path);
+
+    #if defined(__nob_msvc__)
+        if (dependencyFile != "" && !remote)
+        {
+            std::string deps = TakeShowIncludes(ret.output);
+            if (ret.exitCode == 0)
+            {
+                std::ofstream(dependencyFile) << dependencyFile.stem().string() << ".obj: \\\n" << deps << "\n";
+            }
+        }
+    #endif
+
+        if (!suppressOutput && ret.output != "")
+        {
+            Log(ret.output);
+        }
+
+        if (ret.errors != "")
+        {
+            size_t start = 0;
+            while (start < ret.errors.size())
+            {
+                size_t end = std::min(ret.errors.find('\n', start), ret.errors.size());
+                Log(ret.errors.substr(start, end - start) + "\n", plainErrors ? LogType::None : LogType::Error);
+                start = end + 1;
+            }
+        }
+
+        if (ret.exitCode == 0 && kind == CommandKind::Compile)
+        {
+            DefaultTimeReport.Add(*this, ret);
+        }
+
+        if (ret.exitCode == 0 && !outputs.empty())
+        {
+            RecordBuild(*this, std::move(inputTimes), started, ret.seconds, ret.peakMemory);
+            if (cacheable)
+            {
+                DefaultObjectCache.Store(cacheKey, outputs[0].path, dependencyFile);
+            }
+        }
+
+        Log("Done\n", LogType::Run);
+
+        DefaultBuildTrace.Record(*this, traceStart, ret);
+        return ret;
+    }
+
+    bool Command::IsUpToDate()
+    {
+        if (CLFlags[CLArgument::Clean] || outputs.empty())
+        {
+            return false;  // nothing says when a command without outputs is done
+        }
+
+        uint64_t hash = HashString(text);
+        BuildRecord record;
+        bool recorded = false;
+        bool unrecorded = false;
+        for (TrackedFile& output : outputs)
+        {
+            if (GetWriteTime(output.path) == INT64_MIN)
+            {
+                if (output.optional) continue;
+                return false;
+            }
+
+            if (!DefaultBuildLog.Find(output.path, record))
+            {
+                unrecorded = true;
+            }
+            else if (record.commandHash != hash)
+            {
+                Log("Command changed since the last build.\n", LogType::Run);
+                return false;
+            }
+            else
+            {
+                recorded = true;
+            }
+        }
+
+        if (recorded && !unrecorded)
+        {
+            // one stat per recorded file, without reading the dependency file or comparing output times
+            std::unordered_map<std::string, int64_t> rewritten;
+            for (const std::vector<RecordedFile>* files : { &record.inputs, &record.dependencies })
+            {
+                for (const RecordedFile& file : *files)
+                {
+                    int64_t writeTime = GetWriteTime(file.path);
+                    if (writeTime == file.writeTime) continue;
+
+                    // early cutoff: an input that was rebuilt into the same bytes changes nothing
+                    if (file.contentHash != 0 && ContentHash(file.path, writeTime) == file.contentHash)
+                    {
+                        rewritten[file.path.string()] = writeTime;
+                        continue;
+                    }
+                    return false;
+                }
+            }
+
+            if (!rewritten.empty())
+            {
+                Log("Rebuilt inputs are unchanged.\n", LogType::Run);
+
+                // logged with the new times, so the next check is back to one stat per file
+                for (TrackedFile& output : outputs)
+                {
+                    BuildRecord updated;
+                    if (!DefaultBuildLog.Find(output.path, updated)) continue;
+                    for (RecordedFile& input : updated.inputs)
+                    {
+                        auto it = rewritten.find(input.path.string());
+                        if (it != rewritten.end()) input.writeTime = it->second;
+                    }
+                    DefaultBuildLog.Record(output.path, updated);
+                }
+            }
+            return true;
+        }
+
+        // not in the log (built by an older nobpp, or the log was deleted), so compare file times
+        latestInput = 1.0;
+        earliestOutput = DBL_MAX;
+        for (const TrackedFile& input : inputs)
+        {
+            latestInput = std::max(latestInput, WriteSeconds(input.path, input.optional ? 0.0 : FLT_MAX));
+        }
+        for (const TrackedFile& output : outputs)
+        {
+            earliestOutput = std::min(earliestOutput, WriteSeconds(output.path, output.optional ? DBL_MAX : 0.0));
+        }
+
+        if (dependencyFile != "")
+        {
+            if (!std::filesystem::exists(dependencyFile))
+            {
+                return false;  // never built with dependency output, so the headers are unknown
+            }
+
+            for (const std::filesystem::path& dep : ParseDependencyFile(dependencyFile))
+            {
+                latestInput = std::max(latestInput, WriteSeconds(dep, FLT_MAX));
+            }
+        }
+
+        return latestInput < earliestOutput;
+    }
+
+    std::vector<std::string> SplitArguments(std::string text)
+    {
+        std::vector<std::string> ret;
+        std::string current;
+        bool inArgument = false;
+        bool quoted = false;
+
+        for (size_t i = 0; i < text.size(); i++)
+        {
+            char c = text[i];
+        #ifdef _WIN32
+            // CommandLineToArgvW rules: 2n backslashes before a quote are n backslashes, 2n+1 escape the quote
+            if (c == '\\')
+            {
+                size_t count = 0;
+                while (i < text.size() && text[i] == '\\') { count++; i++; }
+                if (i < text.size() && text[i] == '"')
+                {
+                    current.append(count / 2, '\\');
+                    if (count % 2 == 1) current += '"';
+                    else quoted = !quoted;
+                }
+                else
+                {
+                    current.append(count, '\\');
+                    i--;
+                }
+                inArgument = true;
+            }
+        #else
+            // POSIX shell rules: a backslash escapes anything outside quotes, but only \ " $ ` inside them
+            if (c == '\\' && i + 1 < text.size())
+            {
+                char n = text[i + 1];
+                if (!quoted || n == '\\' || n == '"' || n == '$' || n == '`')
+                {
+                    current += n;
+                    i++;
+                }
+                else
+                {
+                    current += c;
+                }
+                inArgument = true;
+            }
+            else if (c == '\'' && !quoted)
+            {
+                size_t end = text.find('\'', i + 1);
+                if (end == std::string::npos) end = text.size();
+                current += text.substr(i + 1, end - i - 1);
+                i = end;
+                inArgument = true;
+            }
+        #endif
+            else if (c == '"')
+            {
+                quoted = !quoted;
+                inArgument = true;
+            }
+            else if ((c == ' ' || c == '\t' || c == '\n') && !quoted)
+            {
+                if (inArgument) ret.push_back(current);
+                current.clear();
+                inArgument = false;
+            }
+            else
+            {
+                current += c;
+                inArgument = true;
+            }
+        }
+        if (inArgument) ret.push_back(current);
+
+        return ret;
+    }
+
+    std::string QuoteArgument(const std::string& arg)
+    {
+        if (arg != "" && arg.find_first_of(" \t\n\v\"") == std::string::npos)
+        {
+            return arg;
+        }
+
+        std::string ret = "\"";
+        for (size_t i = 0; i < arg.size(); i++)
+        {
+            size_t count = 0;
+            while (i < arg.size() && arg[i] == '\\') { count++; i++; }
+
+            if (i == arg.size())
+            {
+                ret.append(count * 2, '\\');
+                break;
+            }
+            else if (arg[i] == '"')
+            {
+                ret.append(count * 2 + 1, '\\');
+            }
+            else
+            {
+                ret.append(count, '\\');
+            }
+            ret += arg[i];
+        }
+        return ret + "\"";
+    }
+
+    namespace
+    {
+    #ifdef _WIN32
+        using ChildProcess = HANDLE;
+    #else
+        using ChildProcess = pid_t;
+    #endif
+
+        // the processes RunProcess is waiting for, so a failed build or Ctrl+C can stop them. Atomics in a
+        // fixed array, since a signal handler cannot take a lock (children past the 256th are not tracked)
+        std::atomic<ChildProcess> RunningChildren[256];
+
+        size_t TrackChild(ChildProcess child)
+        {
+            for (size_t i = 0; i < std::size(RunningChildren); i++)
+            {
+                ChildProcess empty = 0;
+                if (RunningChildren[i].compare_exchange_strong(empty, child)) return i;
+            }
+            return SIZE_MAX;
+        }
+
+        void UntrackChild(size_t slot)
+        {
+            if (slot < std::size(RunningChildren)) RunningChildren[slot] = 0;
+        }
+
+        void TerminateChildren()
+        {
+            for (std::atomic<ChildProcess>& child : RunningChildren)
+            {
+                ChildProcess process = child.load();
+                if (process == 0) continue;
+            #ifdef _WIN32
+                TerminateProcess(process, 1);
+            #else
+                kill(process, SIGTERM);
+            #endif
+            }
+        }
+
+        // children started from a terminal get its Ctrl+C themselves, this is for a signal sent to nobpp alone
+    #ifdef _WIN32
+        BOOL WINAPI StopChildren(DWORD)
+        {
+            TerminateChildren();
+            return FALSE;  // carry on to the default handler, which exits
+        }
+    #else
+        void StopChildren(int signal)
+        {
+            TerminateChildren();
+            std::signal(signal, SIG_DFL);
+            std::raise(signal);
+        }
+    #endif
+
+        void HandleInterrupts()
+        {
+            static std::once_flag once;
+            std::call_once(once, []()
+                {
+                #ifdef _WIN32
+                    SetConsoleCtrlHandler(StopChildren, TRUE);
+                #else
+                    for (int signal : { SIGINT, SIGTERM, SIGHUP })
+                    {
+                        struct sigaction previous = {};
+                        sigaction(signal, nullptr, &previous);
+                        if (previous.sa_handler == SIG_DFL) std::signal(signal, StopChildren);  // leaves the script's own handlers alone
+                    }
+                #endif
+                });
+        }
+
+    #ifndef _WIN32
+        // close-on-exec, so a child that another thread starts meanwhile does not hold our pipe open
+        // (the dup2 onto stdout and stderr clears the flag for our own child)
+        bool OpenPipe(int fds[2])
+        {
+        #if defined(__linux__)
+            return pipe2(fds, O_CLOEXEC) == 0;
+        #else
+            if (pipe(fds) != 0) return false;
+            fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+            fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+            return true;
+        #endif
+        }
+    #endif
+    }
+
+    ProcessResult SpawnProcess(std::vector<std::string> args, const std::filesystem::path& workingDirectory, bool inheritOutput)
+    {
+        ProcessResult ret;
+        if (args.empty())
+        {
+            ret.exitCode = -1;
+            return ret;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        HandleInterrupts();
+
+    #ifdef _WIN32
+        std::string commandLine;
+        if (args[0] == "cmd" && args.size() == 4 && args[1] == "/S")
+        {
+            commandLine = "cmd /S /C " + args[3];  // cmd does its own (different) quote parsing
+        }
+        else
+        {
+            for (const std::string& arg : args)
+            {
+                commandLine += (commandLine == "" ? "" : " ") + QuoteArgument(arg);
+            }
+        }
+
+        SECURITY_ATTRIBUTES security = { sizeof(SECURITY_ATTRIBUTES), NULL, TRUE };
+        HANDLE outRead = NULL, outWrite = NULL, errRead = NULL, errWrite = NULL;
+
+        STARTUPINFOEXA startup = {};
+        startup.StartupInfo.cb = sizeof(STARTUPINFOEXA);
+        std::vector<char> attributeBuffer;
+        HANDLE inherited[2];
+
+        if (!inheritOutput)
+        {
+            CreatePipe(&outRead, &outWrite, &security, 0);
+            CreatePipe(&errRead, &errWrite, &security, 0);
+            SetHandleInformation(outRead, HANDLE_FLAG_INHERIT, 0);
+            SetHandleInformation(errRead, HANDLE_FLAG_INHERIT, 0);
+
+            startup.StartupInfo.dwFlags = STARTF_USESTDHANDLES;
+            startup.StartupInfo.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
+            startup.StartupInfo.hStdOutput = outWrite;
+            startup.StartupInfo.hStdError = errWrite;
+
+            // only hand this job's pipes to the child, otherwise parallel jobs inherit each other's pipes
+            // and a pipe is not closed until every process holding it has exited
+            SIZE_T size = 0;
+            InitializeProcThreadAttributeList(NULL, 1, 0, &size);
+            attributeBuffer.resize(size);
+            startup.lpAttributeList = (LPPROC_THREAD_ATTRIBUTE_LIST)attributeBuffer.data();
+            InitializeProcThreadAttributeList(startup.lpAttributeList, 1, 0, &size);
+            inherited[0] = outWrite;
+            inherited[1] = errWrite;
+            UpdateProcThreadAttribute(startup.lpAttributeList, 0, PROC_THREAD_ATTRIBUTE_HANDLE_LIST, inherited, sizeof(inherited), NULL, NULL);
+        }
+
+        PROCESS_INFORMATION process = {};
+        std::string directory = workingDirectory.string();
+        BOOL created = CreateProcessA(NULL, commandLine.data(), NULL, NULL, inheritOutput ? FALSE : TRUE,
+            inheritOutput ? 0 : EXTENDED_STARTUPINFO_PRESENT, NULL, directory == "" ? NULL : directory.c_str(), &startup.StartupInfo, &process);
+
+        if (!inheritOutput)
+        {
+            DeleteProcThreadAttributeList(startup.lpAttributeList);
+            CloseHandle(outWrite);
+            CloseHandle(errWrite);
+        }
+
+        if (!created)
+        {
+            ret.exitCode = -1;
+            ret.errors = "Could not start " + args[0] + " (error " + std::to_string(GetLastError()) + ")\n";
+        }
+        else
+        {
+            size_t slot = TrackChild(process.hProcess);
+            if (!inheritOutput)
+            {
+                auto drain = [](HANDLE pipe, std::string& out)
+                    {
+                        char buffer[4096];
+                        DWORD count = 0;
+                        while (ReadFile(pipe, buffer, sizeof(buffer), &count, NULL) && count > 0)
+                        {
+                            out.append(buffer, count);
+                        }
+                    };
+
+                // anonymous pipes cannot be polled, so stderr gets its own thread
+                std::thread errThread(drain, errRead, std::ref(ret.errors));
+                drain(outRead, ret.output);
+                errThread.join();
+            }
+
+            WaitForSingleObject(process.hProcess, INFINITE);
+            UntrackChild(slot);
+            DWORD code = 0;
+            GetExitCodeProcess(process.hProcess, &code);
+            ret.exitCode = (int)code;
+            PROCESS_MEMORY_COUNTERS memory = {};
+            if (GetProcessMemoryInfo(process.hProcess, &memory, sizeof(memory)))
+            {
+                ret.peakMemory = memory.PeakWorkingSetSize;
+            }
+            CloseHandle(process.hProcess);
+            CloseHandle(process.hThread);
+        }
+
+        if (!inheritOutput)
+        {
+            CloseHandle(outRead);
+            CloseHandle(errRead);
+        }
+    #else
+        std::vector<char*> argv;
+        for (std::string& arg : args)
+        {
+            argv.push_back(arg.data());
+        }
+        argv.push_back(nullptr);
+
+        int outPipe[2] = { -1, -1 };
+        int errPipe[2] = { -1, -1 };
+        if (!inheritOutput && (!OpenPipe(outPipe) || !OpenPipe(errPipe)))
+        {
+            for (int fd : { outPipe[0], outPipe[1] })
+            {
+                if (fd >= 0) close(fd);
+            }
+            ret.exitCode = -1;
+            ret.errors = "Could not create pipes for " + args[0] + "\n";
+            return ret;
+        }
+
+        pid_t pid = -1;
+        int error = 0;
+        std::error_code ec;
+        bool sameDirectory = workingDirectory.empty() || std::filesystem::equivalent(workingDirectory, std::filesystem::current_path(), ec);
+
+        if (sameDirectory)
+        {
+            posix_spawn_file_actions_t actions;
+            posix_spawn_file_actions_init(&actions);
+            if (!inheritOutput)
+            {
+                posix_spawn_file_actions_adddup2(&actions, outPipe[1], STDOUT_FILENO);
+                posix_spawn_file_actions_adddup2(&actions, errPipe[1], STDERR_FILENO);
+                posix_spawn_file_actions_addclose(&actions, outPipe[0]);
+                posix_spawn_file_actions_addclose(&actions, errPipe[0]);
+                posix_spawn_file_actions_addclose(&actions, outPipe[1]);
+                posix_spawn_file_actions_addclose(&actions, errPipe[1]);
+            }
+            error = posix_spawnp(&pid, argv[0], &actions, nullptr, argv.data(), environ);
+            posix_spawn_file_actions_destroy(&actions);
+        }
+        else
+        {
+            // posix_spawn has no portable way to change directory
+            std::string directory = workingDirectory.string();
+            pid = fork();
+            if (pid == 0)
+            {
+                if (!inheritOutput)
+                {
+                    dup2(outPipe[1], STDOUT_FILENO);
+                    dup2(errPipe[1], STDERR_FILENO);
+                    close(outPipe[0]); close(errPipe[0]); close(outPipe[1]); close(errPipe[1]);
+                }
+                if (chdir(directory.c_str()) == 0)
+                {
+                    execvp(argv[0], argv.data());
+                }
+                _exit(127);
+            }
+            error = pid < 0 ? errno : 0;
+        }
+
+        if (!inheritOutput)
+        {
+            close(outPipe[1]);
+            close(errPipe[1]);
+        }
+
+        size_t slot = error == 0 ? TrackChild(pid) : SIZE_MAX;
+        if (error != 0)
+        {
+            ret.exitCode = 127;
+            ret.errors = "Could not start " + args[0] + ": " + std::string(std::strerror(error)) + "\n";
+        }
+        else if (!inheritOutput)
+        {
+            pollfd fds[2] = { { outPipe[0], POLLIN, 0 }, { errPipe[0], POLLIN, 0 } };
+            std::string* outs[2] = { &ret.output, &ret.errors };
+            int open = 2;
+            char buffer[4096];
+            while (open > 0)
+            {
+                if (poll(fds, 2, -1) < 0)
+                {
+                    if (errno == EINTR) continue;
+                    break;
+                }
+                for (int i = 0; i < 2; i++)
+                {
+                    if (fds[i].fd >= 0 && fds[i].revents != 0)
+                    {
+                        ssize_t count = read(fds[i].fd, buffer, sizeof(buffer));
+                        if (count > 0)
+                        {
+                            outs[i]->append(buffer, count);
+                        }
+                        else if (count == 0 || errno != EINTR)
+                        {
+                            fds[i].fd = -1;  // poll ignores negative descriptors
+                            open--;
+                        }
+                    }
+                }
+            }
+        }
+
+        if (!inheritOutput)
+        {
+            close(outPipe[0]);
+            close(errPipe[0]);
+        }
+
+        if (error == 0)
+        {
+            int status = 0;
+            rusage usage = {};
+            // wait without reaping first, so Ctrl+C cannot signal a new process given the pid between the two
+            siginfo_t info = {};
+            while (waitid(P_PID, (id_t)pid, &info, WEXITED | WNOWAIT) < 0 && errno == EINTR) {}
+            UntrackChild(slot);
+            while (wait4(pid, &status, 0, &usage) < 0 && errno == EINTR) {}
+            ret.exitCode = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+        #if defined(__APPLE__)
+            ret.peakMemory = (uint64_t)usage.ru_maxrss;  // already in bytes on macOS
+        #else
+            ret.peakMemory = (uint64_t)usage.ru_maxrss * 1024;  // includes the children it waited for, like cc1plus under g++
+        #endif
+        }
+    #endif
+
+        ret.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return ret;
+    }
+
+    namespace
+    {
+        enum class ResponseFileQuoting { None, Gnu, Windows };
+
+        // Which tools read @file arguments, and how they split them. GCC and binutils unescape
+        // backslashes anywhere, MSVC tools and Clang on Windows follow the CRT command line rules
+        ResponseFileQuoting GetResponseFileQuoting(const std::string& program)
+        {
+            std::string name = std::filesystem::path(program).filename().string();
+            for (char& c : name) c = (char)std::tolower((unsigned char)c);
+            if (name.size() > 4 && name.substr(name.size() - 4) == ".exe") name.resize(name.size() - 4);
+
+            size_t dash = name.find_last_of('-');  // g++-13, clang-18
+            if (dash != std::string::npos && dash + 1 < name.size() && name.find_first_not_of("0123456789.", dash + 1) == std::string::npos)
+            {
+                name.resize(dash);
+            }
+
+            auto is = [&](const std::string& tool)
+                {
+                    return name == tool || (name.size() > tool.size() && name.substr(name.size() - tool.size() - 1) == "-" + tool);  // x86_64-linux-gnu-g++
+                };
+
+            if (is("cl") || is("link") || is("lib") || is("lld-link") || is("clang-cl") || is("llvm-lib"))
+            {
+                return ResponseFileQuoting::Windows;
+            }
+            if (is("clang") || is("clang++"))
+            {
+            #ifdef _WIN32
+                return ResponseFileQuoting::Windows;
+            #else
+                return ResponseFileQuoting::Gnu;
+            #endif
+            }
+            if (is("gcc") || is("g++") || is("cc") || is("c++") || is("ar") || is("llvm-ar") || is("ld") || is("ld.lld") || is("ld.gold") || is("mold"))
+            {
+                return ResponseFileQuoting::Gnu;
+            }
+            return ResponseFileQuoting::None;
+        }
+
+        std::string ResponseFileArgument(const std::string& arg, ResponseFileQuoting quoting)
+        {
+            if (quoting == ResponseFileQuoting::Windows)
+            {
+                return QuoteArgument(arg);
+            }
+
+            std::string ret = "\"";
+            for (char c : arg)
+            {
+                if (c == '\\' || c == '"') ret += '\\';
+                ret += c;
+            }
+            return ret + "\"";
+        }
+
+        size_t ArgumentsLength(const std::vector<std::string>& args, size_t begin, size_t end)
+        {
+            size_t length = 0;
+            for (size_t i = begin; i < end; i++)
+            {
+                length += args[i].size() + 3;  // a separator and possibly quotes
+            }
+            return length;
+        }
+
+        std::atomic<uint64_t> ResponseFileCounter = 0;
+
+        // Replaces args[begin, end) with a single @file argument
+        bool WriteResponseFile(std::vector<std::string>& args, size_t begin, size_t end, ResponseFileQuoting quoting, std::vector<std::filesystem::path>& files)
+        {
+            std::string content;
+            for (size_t i = begin; i < end; i++)
+            {
+                content += ResponseFileArgument(args[i], quoting) + "\n";
+            }
+
+            char name[40];
+            uint64_t unique = HashString(content) ^ (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count() ^ (ResponseFileCounter++ << 48);
+            std::snprintf(name, sizeof(name), "nobpp-%016llx.rsp", (unsigned long long)unique);
+
+            std::error_code ec;
+            std::filesystem::path file = std::filesystem::temp_directory_path(ec) / name;
+            std::ofstream stream(file, std::ios::binary);
+            stream << content;
+            stream.close();
+            if (ec || !stream)
+            {
+                return false;
+            }
+
+            files.push_back(file);
+            args.erase(args.begin() + begin + 1, args.begin() + end);
+            args[begin] = "@" + file.string();
+            return true;
+        }
+    }
+
+    ProcessResult RunProcess(std::vector<std::string> args, std::filesystem::path workingDirectory, bool inheritOutput)
+    {
+        std::vector<std::filesystem::path> responseFiles;
+        ResponseFileQuoting quoting = args.size() > 1 ? GetResponseFileQuoting(args[0]) : ResponseFileQuoting::None;
+        if (quoting != ResponseFileQuoting::None && ArgumentsLength(args, 0, args.size()) > NOBPP_RESPONSE_FILE_THRESHOLD)
+        {
+            // cl only reads compiler options from the file, so what follows -link gets its own file
+            size_t link = args.size();
+            if (quoting == ResponseFileQuoting::Windows)
+            {
+                for (size_t i = 1; i < args.size(); i++)
+                {
+                    std::string arg = args[i];
+                    for (char& c : arg) c = (char)std::tolower((unsigned char)c);
+                    if (arg == "-link" || arg == "/link")
+                    {
+                        link = i;
+                        break;
+                    }
+                }
+            }
+
+            if (link + 1 < args.size() && ArgumentsLength(args, link + 1, args.size()) > NOBPP_RESPONSE_FILE_THRESHOLD / 2)
+            {
+                WriteResponseFile(args, link + 1, args.size(), quoting, responseFiles);
+            }
+            if (link > 1)
+            {
+                WriteResponseFile(args, 1, link, quoting, responseFiles);
+            }
+        }
+
+        if (inheritOutput) FlushLog();  // the child writes to the same terminal
+        ProcessResult ret = SpawnProcess(std::move(args), workingDirectory, inheritOutput);
+
+        for (const std::filesystem::path& file : responseFiles)
+        {
+            std::error_code ec;
+            std::filesystem::remove(file, ec);
+        }
+        return ret;
+    }
+
+    void Command::UpdateInputTime(std::filesystem::path file, bool skipOnFail)
+    {
+        // no duplicate check: searching the list on every append made a link of N objects O(N^2)
+        latestInput = std::max(latestInput, WriteSeconds(file, skipOnFail ? 0.0 : FLT_MAX));
+        inputs.push_back({ std::move(file), skipOnFail });
+    }
+
+    void Command::UpdateOutputTime(std::filesystem::path file, bool skipOnFail)
+    {
+        earliestOutput = std::min(earliestOutput, WriteSeconds(file, skipOnFail ? DBL_MAX : 0.0));
+        outputs.push_back({ std::move(file), skipOnFail });
+    }
+
+    Command operator+(Command a, std::string b)
+    {
+        if (a.text != "") a.text += ' ';
+        a.text += b;
+        return a;
+    }
+
+    Command operator-(Command a, std::string b)
+    {
+        a.text += b;
+        return a;
+    }
+
+    Command operator+(Command a, std::filesystem::path b)
+    {
+        return std::move(a) + ("\"" + b.string() + "\"");
+    }
+
+    Command operator-(Command a, std::filesystem::path b)
+    {
+        return std::move(a) - ("\"" + b.string() + "\"");
+    }
+
+    Command operator+(Command a, Command b)
+    {
+        return std::move(a) + std::string("&&") + b.text;
+    }
+
+    Command operator-(Command a, Command b)
+    {
+        return std::move(a) + b.text;
+    }
+
+
+// --------------------------- BUILD LOG -----------------------------
+
+    uint64_t HashBytes(const void* data, size_t size, uint64_t seed)
+    {
+        const uint64_t p1 = 11400714785074694791ULL, p2 = 14029467366897019727ULL, p3 = 1609587929392839161ULL,
+            p4 = 9650029242287828579ULL, p5 = 2870177450012600261ULL;
+        auto rotl = [](uint64_t x, int r) { return (x << r) | (x >> (64 - r)); };
+        auto read64 = [](const unsigned char* p) { uint64_t v; std::memcpy(&v, p, 8); return v; };  // assumes little-endian
+        auto read32 = [](const unsigned char* p) { uint32_t v; std::memcpy(&v, p, 4); return (uint64_t)v; };
+        auto round = [&](uint64_t acc, uint64_t input) { return rotl(acc + input * p2, 31) * p1; };
+        auto merge = [&](uint64_t acc, uint64_t val) { return (acc ^ round(0, val)) * p1 + p4; };
+
+        const unsigned char* p = (const unsigned char*)data;
+        const unsigned char* end = p + size;
+        uint64_t h;
+
+        if (size >= 32)
+        {
+            uint64_t v1 = seed + p1 + p2, v2 = seed + p2, v3 = seed, v4 = seed - p1;
+            for (; p + 32 <= end; p += 32)
+            {
+                v1 = round(v1, read64(p));
+                v2 = round(v2, read64(p + 8));
+                v3 = round(v3, read64(p + 16));
+                v4 = round(v4, read64(p + 24));
+            }
+            h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+            h = merge(merge(merge(merge(h, v1), v2), v3), v4);
+        }
+        else
+        {
+            h = seed + p5;
+        }
+
+        h += size;
+        for (; p + 8 <= end; p += 8)
+        {
+            h = rotl(h ^ round(0, read64(p)), 27) * p1 + p4;
+        }
+        if (p + 4 <= end)
+        {
+            h = rotl(h ^ (read32(p) * p1), 23) * p2 + p3;
+            p += 4;
+        }
+        for (; p < end; p++)
+        {
+            h = rotl(h ^ (*p * p5), 11) * p1;
+        }
+
+        h ^= h >> 33; h *= p2;
+        h ^= h >> 29; h *= p3;
+        h ^= h >> 32;
+        return h;
+    }
+
+    uint64_t HashString(const std::string& str)
+    {
+        return HashBytes(str.data(), str.size());
+    }
+
+    uint64_t HashFile(const std::filesystem::path& file)
+    {
+        std::ifstream in(file, std::ios::binary);
+        if (!in) return 0;
+        std::string content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        return HashBytes(content.data(), content.size());
+    }
+
+    namespace
+    {
+        const char BuildLogMagic[] = "NOBPPLOG";
+        const uint32_t BuildLogVersion = 3;
+
+        template<typename T> void WriteValue(std::string& out, T value)
+        {
+            out.append((const char*)&value, sizeof(T));
+        }
+
+        void WriteString(std::string& out, const std::string& value)
+        {
+            WriteValue<uint32_t>(out, (uint32_t)value.size());
+            out += value;
+        }
+
+        struct LogReader
+        {
+            const std::string& data;
+            size_t pos = 0;
+            bool failed = false;
+
+            template<typename T> T Value()
+            {
+                T ret{};
+                if (pos + sizeof(T) > data.size()) { failed = true; return ret; }
+                std::memcpy(&ret, data.data() + pos, sizeof(T));
+                pos += sizeof(T);
+                return ret;
+            }
+
+            std::string String()
+            {
+                uint32_t size = Value<uint32_t>();
+                if (failed || pos + size > data.size()) { failed = true; return ""; }
+                pos += size;
+                return data.substr(pos - size, size);
+            }
+        };
+
+        void WriteRecord(std::string& out, const std::string& output, const BuildRecord& record)
+        {
+            std::string body;
+            WriteString(body, output);
+            WriteString(body, record.command);
+            WriteValue<uint64_t>(body, record.commandHash);
+            WriteValue<double>(body, record.seconds);
+            WriteValue<uint64_t>(body, record.peakMemory);
+            WriteValue<int64_t>(body, record.outputTime);
+            WriteValue<uint64_t>(body, record.outputHash);
+            for (const std::vector<RecordedFile>* files : { &record.inputs, &record.dependencies })
+            {
+                WriteValue<uint32_t>(body, (uint32_t)files->size());
+                for (const RecordedFile& file : *files)
+                {
+                    WriteString(body, file.path.string());
+                    WriteValue<int64_t>(body, file.writeTime);
+                    WriteValue<uint64_t>(body, file.contentHash);
+                }
+            }
+            WriteValue<uint32_t>(out, (uint32_t)body.size());
+            out += body;
+        }
+
+        std::string LogKey(const std::filesystem::path& output)
+        {
+            return std::filesystem::absolute(output).lexically_normal().string();
+        }
+    }
+
+    void BuildLog::Load()
+    {
+        loaded = true;
+        if (file.empty())
+        {
+            file = (ThisExecutablePath.empty() ? std::filesystem::current_path() : ThisExecutablePath.parent_path()) / ".nobpplog";
+        }
+
+        std::string data;
+        {
+            std::ifstream in(file, std::ios::binary);
+            data.assign((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        }
+
+        LogReader reader{ data };
+        size_t total = 0;
+        bool valid = data.compare(0, sizeof(BuildLogMagic) - 1, BuildLogMagic) == 0;
+        reader.pos = sizeof(BuildLogMagic) - 1;
+        valid = valid && reader.Value<uint32_t>() == BuildLogVersion && !reader.failed;
+
+        while (valid && reader.pos < data.size())
+        {
+            uint32_t size = reader.Value<uint32_t>();
+            size_t end = reader.pos + size;
+            std::string output = reader.String();
+            BuildRecord record;
+            record.command = reader.String();
+            record.commandHash = reader.Value<uint64_t>();
+            record.seconds = reader.Value<double>();
+            record.peakMemory = reader.Value<uint64_t>();
+            record.outputTime = reader.Value<int64_t>();
+            record.outputHash = reader.Value<uint64_t>();
+            for (std::vector<RecordedFile>* files : { &record.inputs, &record.dependencies })
+            {
+                uint32_t count = reader.Value<uint32_t>();
+                for (uint32_t i = 0; i < count && !reader.failed; i++)
+                {
+                    std::string path = reader.String();
+                    int64_t writeTime = reader.Value<int64_t>();
+                    files->push_back({ { path }, writeTime, reader.Value<uint64_t>() });
+                }
+            }
+            if (reader.failed || reader.pos != end) break;  // a record cut off by a crash, drop it and everything after
+
+            records[output] = std::move(record);
+            total++;
+        }
+
+        // rewrite the file when it is new, damaged, from another version, or mostly superseded records
+        if (!valid || reader.pos != data.size() || total > 3 * records.size() + 64)
+        {
+            std::string out = BuildLogMagic;
+            WriteValue<uint32_t>(out, BuildLogVersion);
+            for (auto& [output, record] : records)
+            {
+                WriteRecord(out, output, record);
+            }
+            std::ofstream(file, std::ios::binary | std::ios::trunc).write(out.data(), out.size());
+        }
+
+        stream.open(file, std::ios::binary | std::ios::app);
+    }
+
+    bool BuildLog::Find(std::filesystem::path output, BuildRecord& out)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!loaded) Load();
+
+        auto it = records.find(LogKey(output));
+        if (it == records.end()) return false;
+        out = it->second;
+        return true;
+    }
+
+    void BuildLog::Record(std::filesystem::path output, const BuildRecord& record)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!loaded) Load();
+
+        std::string key = LogKey(output);
+        std::string out;
+        WriteRecord(out, key, record);
+        stream.write(out.data(), out.size());
+        stream.flush();
+        records[key] = record;
+    }
+
+
+// --------------------------- BUILD TRACE -----------------------------
+
+    namespace
+    {
+        std::string JsonString(const std::string& str)
+        {
+            std::string ret = "\"";
+            for (char c : str)
+            {
+                switch (c)
+                {
+                case '"': ret += "\\\""; break;
+                case '\\': ret += "\\\\"; break;
+                case '\n': ret += "\\n"; break;
+                case '\r': ret += "\\r"; break;
+                case '\t': ret += "\\t"; break;
+                default:
+                    if ((unsigned char)c < 0x20)
+                    {
+                        char escaped[7];
+                        std::snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned int)c);
+                        ret += escaped;
+                    }
+                    else
+                    {
+                        ret += c;
+                    }
+                }
+            }
+            return ret + "\"";
+        }
+    }
+
+    BuildTrace::BuildTrace()
+        : origin(std::chrono::steady_clock::now())
+    {
+        threads[std::this_thread::get_id()] = 0;  // constructed before main, so this is the main thread
+    }
+
+    double BuildTrace::Now()
+    {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - origin).count();
+    }
+
+    void BuildTrace::Record(const Command& cmd, double start, const ProcessResult& result, bool cached)
+    {
+        if (file == "") return;
+
+        Event event;
+        event.start = start;
+        event.end = Now();
+        event.exitCode = result.exitCode;
+        event.skipped = result.skipped;
+        event.cached = cached;
+        event.command = cmd.text;
+        event.target = cmd.outputs.empty() ? "" : cmd.outputs[0].path.string();
+        event.name = cmd.outputs.empty() ? cmd.text.substr(0, cmd.text.find(' ')) : cmd.outputs[0].path.filename().string();
+        event.category = cmd.kind == CommandKind::Compile ? "compile" : cmd.kind == CommandKind::Link ? "link" : cmd.kind == CommandKind::Library ? "archive" : "command";
+        if (event.skipped) event.category += ",skipped";
+        if (event.cached) event.category += ",cached";
+
+        std::lock_guard<std::mutex> lock(mutex);
+        auto [it, added] = threads.insert({ std::this_thread::get_id(), (int)threads.size() });
+        event.thread = it->second;
+        events.push_back(event);
+    }
+
+    void BuildTrace::Write()
+    {
+        if (file == "") return;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        for (auto& [id, thread] : threads)
+        {
+            out += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" + std::to_string(thread)
+                + ",\"args\":{\"name\":" + JsonString(thread == 0 ? "main" : "worker " + std::to_string(thread)) + "}},\n";
+        }
+        for (const Event& event : events)
+        {
+            char times[64];
+            std::snprintf(times, sizeof(times), "\"ts\":%.3f,\"dur\":%.3f", event.start, event.end - event.start);
+            out += "{\"name\":" + JsonString(event.name) + ",\"cat\":" + JsonString(event.category) + ",\"ph\":\"X\"," + times
+                + ",\"pid\":1,\"tid\":" + std::to_string(event.thread) + ",\"args\":{\"target\":" + JsonString(event.target)
+                + ",\"exitCode\":" + std::to_string(event.exitCode) + ",\"skipped\":" + (event.skipped ? "true" : "false")
+                + ",\"cached\":" + (event.cached ? "true" : "false") + ",\"command\":" + JsonString(event.command) + "}},\n";
+        }
+        out += "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"nobpp\"}}\n]}\n";
+
+        std::ofstream stream(file, std::ios::binary);
+        stream << out;
+        if (!stream)
+        {
+            Log("Could not write the trace to " + file.string() + "\n", LogType::Error);
+        }
+    }
+
+
+// --------------------------- TIME REPORT -----------------------------
+
+    namespace
+    {
+        // just enough JSON for -ftime-trace files and P1689 module scans
+        struct JsonValue
+        {
+            enum class Type { Null, Boolean, Number, String, Array, Object } type = Type::Null;
+            double number = 0.0;
+            std::string str;
+            std::vector<JsonValue> array;
+            std::vector<std::pair<std::string, JsonValue>> object;
+
+            const JsonValue* Find(const std::string& key) const
+            {
+                for (const auto& [name, value] : object)
+                {
+                    if (name == key) return &value;
+                }
+                return nullptr;
+            }
+        };
+
+        bool ParseJson(const std::string& text, size_t& i, JsonValue& out, int depth = 0)
+        {
+            auto skip = [&]() { while (i < text.size() && std::isspace((unsigned char)text[i])) i++; };
+            auto parseString = [&](std::string& str)
+                {
+                    for (i++; i < text.size() && text[i] != '"'; i++)
+                    {
+                        if (text[i] != '\\') { str += text[i]; continue; }
+                        if (++i >= text.size()) return false;
+                        switch (text[i])
+                        {
+                        case 'n': str += '\n'; break;
+                        case 't': str += '\t'; break;
+                        case 'r': str += '\r'; break;
+                        case 'b': str += '\b'; break;
+                        case 'f': str += '\f'; break;
+                        case 'u':
+                        {
+                            if (i + 4 >= text.size()) return false;
+                            unsigned int code = std::stoul(text.substr(i + 1, 4), nullptr, 16);
+                            i += 4;
+                            if (code < 0x80) str += (char)code;
+                            else if (code < 0x800) { str += (char)(0xC0 | (code >> 6)); str += (char)(0x80 | (code & 0x3F)); }
+                            else { str += (char)(0xE0 | (code >> 12)); str += (char)(0x80 | ((code >> 6) & 0x3F)); str += (char)(0x80 | (code & 0x3F)); }
+                            break;
+                        }
+                        default: str += text[i]; break;
+                        }
+                    }
+                    if (i >= text.size()) return false;
+                    i++;
+                    return true;
+                };
+
+            skip();
+            if (i >= text.size() || depth > 64) return false;
+            char c = text[i];
+            if (c == '{')
+            {
+                out.type = JsonValue::Type::Object;
+                i++;
+                skip();
+                if (i < text.size() && text[i] == '}') { i++; return true; }
+                while (true)
+                {
+                    skip();
+                    std::string key;
+                    if (i >= text.size() || text[i] != '"' || !parseString(key)) return false;
+                    skip();
+                    if (i >= text.size() || text[i++] != ':') return false;
+                    out.object.push_back({ key, {} });
+                    if (!ParseJson(text, i, out.object.back().second, depth + 1)) return false;
+                    skip();
+                    if (i < text.size() && text[i] == ',') { i++; continue; }
+                    if (i < text.size() && text[i] == '}') { i++; return true; }
+                    return false;
+                }
+            }
+            if (c == '[')
+            {
+                out.type = JsonValue::Type::Array;
+                i++;
+                skip();
+                if (i < text.size() && text[i] == ']') { i++; return true; }
+                while (true)
+                {
+                    out.array.push_back({});
+                    if (!ParseJson(text, i, out.array.back(), depth + 1)) return false;
+                    skip();
+                    if (i < text.size() && text[i] == ',') { i++; continue; }
+                    if (i < text.size() && text[i] == ']') { i++; return true; }
+                    return false;
+                }
+            }
+            if (c == '"')
+            {
+                out.type = JsonValue::Type::String;
+                return parseString(out.str);
+            }
+            if (text.compare(i, 4, "true") == 0 || text.compare(i, 5, "false") == 0)
+            {
+                out.type = JsonValue::Type::Boolean;
+                out.number = c == 't' ? 1.0 : 0.0;
+                i += c == 't' ? 4 : 5;
+                return true;
+            }
+            if (text.compare(i, 4, "null") == 0)
+            {
+                i += 4;
+                return true;
+            }
+
+            char* end = nullptr;
+            out.type = JsonValue::Type::Number;
+            out.number = std::strtod(text.c_str() + i, &end);
+            if (end == text.c_str() + i) return false;
+            i = end - text.c_str();
+            return true;
+        }
+    }
+
+    void TimeReport::Add(const Command& cmd, const ProcessResult& result)
+    {
+        if (cmd.inputs.empty()) return;
+        std::string source = (cmd.sourceFile != "" ? cmd.sourceFile : cmd.inputs[0].path).string();
+
+        std::unordered_map<std::string, Entry> newHeaders;
+        std::unordered_map<std::string, Entry> newTemplates;
+
+        if (cmd.text.find("-ftime-trace") != std::string::npos && !cmd.outputs.empty())
+        {
+            // Clang writes the trace next to the object, as <object stem>.json
+            std::ifstream in(std::filesystem::path(cmd.outputs[0].path).replace_extension(".json"), std::ios::binary);
+            std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+            JsonValue root;
+            size_t i = 0;
+            const JsonValue* events = nullptr;
+            if (text != "" && ParseJson(text, i, root) && (events = root.Find("traceEvents")) != nullptr)
+            {
+                for (const JsonValue& event : events->array)
+                {
+                    const JsonValue* name = event.Find("name");
+                    const JsonValue* duration = event.Find("dur");
+                    const JsonValue* args = event.Find("args");
+                    const JsonValue* detail = args ? args->Find("detail") : nullptr;
+                    if (!name || !duration || !detail) continue;
+
+                    // Source events nest, so a header's time includes the headers it includes
+                    std::unordered_map<std::string, Entry>* into = name->str == "Source" ? &newHeaders
+                        : (name->str == "InstantiateClass" || name->str == "InstantiateFunction") ? &newTemplates : nullptr;
+                    if (!into) continue;
+                    Entry& entry = (*into)[detail->str];
+                    entry.seconds += duration->number / 1000000.0;
+                    entry.count++;
+                }
+            }
+        }
+        else if (cmd.text.find("-d1reportTime") != std::string::npos)
+        {
+            // MSVC prints sections of "name: 0.123s" lines, indented by include depth
+            std::unordered_map<std::string, Entry>* into = nullptr;
+            size_t start = 0;
+            while (start < result.output.size())
+            {
+                size_t end = std::min(result.output.find('\n', start), result.output.size());
+                std::string line = result.output.substr(start, end - start);
+                start = end + 1;
+                if (line != "" && line.back() == '\r') line.pop_back();
+
+                if (line.find("Include Headers:") != std::string::npos) { into = &newHeaders; continue; }
+                if (line.find("Class Definitions:") != std::string::npos || line.find("Function Definitions:") != std::string::npos) { into = &newTemplates; continue; }
+
+                size_t colon = line.rfind(": ");
+                if (!into || colon == std::string::npos || line.size() < 2 || line.back() != 's') continue;
+                std::string name = line.substr(line.find_first_not_of(" \t"));
+                name = name.substr(0, name.rfind(": "));
+                if (name == "Count") continue;
+
+                Entry& entry = (*into)[name];
+                entry.seconds += std::atof(line.c_str() + colon + 2);
+                entry.count++;
+            }
+        }
+        else if (!CLFlags[CLArgument::ReportTime])
+        {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& [from, into] : { std::make_pair(&newHeaders, &headers), std::make_pair(&newTemplates, &templates) })
+        {
+            for (auto& [name, entry] : *from)
+            {
+                (*into)[name].seconds += entry.seconds;
+                (*into)[name].count += entry.count;
+            }
+        }
+        sources[source].seconds += result.seconds;
+        sources[source].count++;
+    }
+
+    void TimeReport::Write()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (sources.empty()) return;
+
+        auto section = [](const std::string& title, const std::unordered_map<std::string, Entry>& entries, size_t limit)
+            {
+                std::vector<std::pair<std::string, Entry>> sorted(entries.begin(), entries.end());
+                std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) { return a.second.seconds > b.second.seconds; });
+
+                std::string ret = title + "\n";
+                for (size_t i = 0; i < sorted.size() && i < limit; i++)
+                {
+                    char line[64];
+                    std::snprintf(line, sizeof(line), "%10.3fs %8zux  ", sorted[i].second.seconds, sorted[i].second.count);
+                    ret += line + sorted[i].first + "\n";
+                }
+                if (sorted.empty()) ret += "    (no data from this compiler)\n";
+                return ret + "\n";
+            };
+
+        std::string summary = section("Most expensive headers (time spent parsing them and what they include, over all sources):", headers, 10)
+            + section("Most expensive templates and definitions (instantiation time, and how many times):", templates, 10)
+            + section("Slowest sources:", sources, 10);
+        Log("Time report:\n" + summary, LogType::Info);
+
+        std::filesystem::path out = file != "" ? file : ThisExecutablePath.parent_path() / "time-report.txt";
+        std::ofstream(out) << section("Headers:", headers, SIZE_MAX) << section("Templates and definitions:", templates, SIZE_MAX) << section("Sources:", sources, SIZE_MAX);
+        Log("The full time report is in " + out.string() + "\n", LogType::Info);
+    }
+
+
+// --------------------------- COMPILER PROBE -----------------------------
+
+    namespace
+    {
+        const char ProbeMagic[] = "NOBPPPRB";
+        const uint32_t ProbeVersion = 1;  // bump when ProbedFlags changes, so old results are probed again
+
+        // the first of programs in a PATH directory, or empty
+        std::filesystem::path FindOnPath(const std::vector<std::string>& programs)
+        {
+            const char* env = std::getenv("PATH");
+            std::string path = env == nullptr ? "" : env;
+#ifdef _WIN32
+            char separator = ';';
+#else
+            char separator = ':';
+#endif
+            for (size_t start = 0; start <= path.size();)
+            {
+                size_t end = std::min(path.find(separator, start), path.size());
+                std::filesystem::path directory = path.substr(start, end - start);
+                for (const std::string& program : programs)
+                {
+                    std::error_code ec;
+                    if (!directory.empty() && std::filesystem::is_regular_file(directory / program, ec)) return directory / program;
+                }
+                start = end + 1;
+            }
+            return {};
+        }
+
+        std::filesystem::path FindCompiler(const std::string& compiler)
+        {
+            std::filesystem::path ret = compiler;
+        #ifdef _WIN32
+            if (!ret.has_extension()) ret += ".exe";
+        #endif
+            std::error_code ec;
+            if (ret.has_parent_path())
+            {
+                if (!std::filesystem::is_regular_file(ret, ec)) return {};
+            }
+            else
+            {
+                ret = FindOnPath({ ret.string() });
+                if (ret.empty()) return {};
+            }
+            std::filesystem::path canonical = std::filesystem::canonical(ret, ec);  // g++ is often a link to g++-12
+            return ec ? ret : canonical;
+        }
+
+        // the flags handlers pick between, which are tried one at a time on an empty source
+        std::vector<std::string> ProbedFlags(CompilerFamily family)
+        {
+            switch (family)
+            {
+            case CompilerFamily::GCC: return { "-std=c++20", "-flto=auto" };  // GCC 10
+            case CompilerFamily::Clang: return { "-std=c++20", "-ftime-trace" };  // Clang 10 and 9
+            case CompilerFamily::MSVC: return { "-std:c++20" };  // VS 2019 16.11
+            default: return {};
+            }
+        }
+
+        // fills in what follows from identity and target
+        void ParseCompilerInfo(CompilerInfo& info)
+        {
+            if (info.identity.find("clang version") != std::string::npos) info.family = CompilerFamily::Clang;
+            else if (info.identity.find("Microsoft") != std::string::npos) info.family = CompilerFamily::MSVC;
+            else if (info.identity.find("Free Software Foundation") != std::string::npos) info.family = CompilerFamily::GCC;
+
+            // the first number with a dot in the first line: "g++-12 (Debian 12.2.0-14) 12.2.0" is 12.2.0
+            std::string line = info.identity.substr(0, info.identity.find('\n'));
+            for (size_t i = 0; i < line.size(); i++)
+            {
+                if (!std::isdigit((unsigned char)line[i]) || (i > 0 && std::isalnum((unsigned char)line[i - 1]))) continue;
+                int major = 0, minor = 0, patch = 0;
+                if (std::sscanf(line.c_str() + i, "%d.%d.%d", &major, &minor, &patch) >= 2)
+                {
+                    info.major = major;
+                    info.minor = minor;
+                    info.patch = patch;
+                    break;
+                }
+            }
+        }
+
+        void WriteCompilerInfo(std::string& out, const CompilerInfo& info, int64_t writeTime)
+        {
+            WriteString(out, info.path.string());
+            WriteValue<int64_t>(out, writeTime);
+            WriteString(out, info.identity);
+            WriteString(out, info.target);
+            WriteValue<uint32_t>(out, (uint32_t)info.flags.size());
+            for (const std::string& flag : info.flags) WriteString(out, flag);
+        }
+
+        // the compiler (or linker driver) cmd runs, looking past a launcher such as ccache g++
+        const CompilerInfo& ProbeProgram(const Command& cmd)
+        {
+            std::vector<std::string> args = SplitArguments(cmd.text);
+            size_t i = 0;
+            while (i + 1 < args.size())
+            {
+                std::string name = std::filesystem::path(args[i]).stem().string();
+                for (char& c : name) c = (char)std::tolower((unsigned char)c);
+                if (name != "ccache" && name != "sccache" && name != "distcc" && name != "icecc" && name != "buildcache") break;
+                i++;
+            }
+            return ProbeCompiler(args.empty() ? "" : args[i]);
+        }
+
+        // whether the handlers should pass flag: when the probe could not tell what the compiler is, they
+        // keep the flag they passed before there was a probe instead of falling back to an older one
+        bool ProbedSupports(const Command& cmd, const std::string& flag)
+        {
+            const CompilerInfo& info = ProbeProgram(cmd);
+            return info.family == CompilerFamily::Unknown || info.Supports(flag);
+        }
+
+        CompilerInfo RunProbe(const std::string& compiler, const std::filesystem::path& path)
+        {
+            CompilerInfo ret;
+            ret.path = path;
+        #if defined(__nob_msvc__)
+            ProcessResult version = RunProcess({ compiler });  // cl prints its version banner when given no arguments
+        #else
+            ProcessResult version = RunProcess({ compiler, "--version" });
+        #endif
+            ret.identity = version.output + version.errors;
+            ParseCompilerInfo(ret);
+
+            if (ret.family == CompilerFamily::MSVC)
+            {
+                std::string line = ret.identity.substr(0, ret.identity.find('\n'));
+                size_t pos = line.rfind(" for ");
+                if (pos != std::string::npos) ret.target = line.substr(pos + 5);
+            }
+            else if (ret.family != CompilerFamily::Unknown)
+            {
+                ret.target = RunProcess({ compiler, "-dumpmachine" }).output;
+            }
+            while (!ret.target.empty() && std::isspace((unsigned char)ret.target.back())) ret.target.pop_back();
+
+            std::error_code ec;
+            std::filesystem::path source = std::filesystem::temp_directory_path(ec) /
+                ("nobpp_probe" + std::to_string(HashString(path.string()) ^ (uint64_t)std::hash<std::thread::id>()(std::this_thread::get_id())));
+            std::filesystem::path object = std::filesystem::path(source).replace_extension(".obj");
+            source.replace_extension(".cpp");
+            std::ofstream(source) << "int nobpp_probe;\n";
+            for (const std::string& flag : ProbedFlags(ret.family))
+            {
+                ProcessResult result = ret.family == CompilerFamily::MSVC ?
+                    RunProcess({ compiler, "-nologo", flag, "-c", source.string(), "-Fo" + object.string() }) :
+                    RunProcess({ compiler, "-Werror", flag, "-c", source.string(), "-o", object.string() });
+                bool ignored = (result.output + result.errors).find("D9002") != std::string::npos;  // cl only warns about unknown options
+                if (result.exitCode == 0 && !ignored) ret.flags.push_back(flag);
+            }
+            std::filesystem::remove(source, ec);
+            std::filesystem::remove(object, ec);
+            std::filesystem::remove(std::filesystem::path(object).replace_extension(".json"), ec);  // from -ftime-trace
+            return ret;
+        }
+    }
+
+    bool CompilerInfo::Supports(const std::string& flag) const
+    {
+        return std::find(flags.begin(), flags.end(), flag) != flags.end();
+    }
+
+    bool CompilerInfo::AtLeast(int atLeastMajor, int atLeastMinor) const
+    {
+        return major > atLeastMajor || (major == atLeastMajor && minor >= atLeastMinor);
+    }
+
+    const CompilerInfo& ProbeCompiler(const std::string& compiler)
+    {
+        static std::mutex mutex;
+        static std::unordered_map<std::string, CompilerInfo> probed;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = probed.find(compiler);
+        if (it != probed.end()) return it->second;
+
+        std::filesystem::path path = FindCompiler(compiler);
+        if (path.empty())
+        {
+            return probed[compiler] = RunProbe(compiler, path);  // not worth keeping, it is probably not there at all
+        }
+        int64_t writeTime = GetWriteTime(path);
+
+        // every compiler this build executable has probed, each one the last time it changed
+        std::filesystem::path file = (ThisExecutablePath.empty() ? std::filesystem::current_path() : ThisExecutablePath.parent_path()) / ".nobppprobe";
+        std::string data;
+        {
+            std::ifstream in(file, std::ios::binary);
+            data.assign((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        }
+
+        std::string kept;
+        LogReader reader{ data };
+        bool current = data.compare(0, 8, ProbeMagic) == 0;
+        reader.pos = 8;
+        current = current && reader.Value<uint32_t>() == ProbeVersion;
+        while (current && reader.pos < data.size())
+        {
+            size_t start = reader.pos;
+            CompilerInfo info;
+            info.path = reader.String();
+            int64_t recorded = reader.Value<int64_t>();
+            info.identity = reader.String();
+            info.target = reader.String();
+            uint32_t count = reader.Value<uint32_t>();
+            for (uint32_t i = 0; i < count && !reader.failed; i++) info.flags.push_back(reader.String());
+            if (reader.failed) break;
+
+            if (info.path != path)
+            {
+                kept += data.substr(start, reader.pos - start);
+            }
+            else if (recorded == writeTime)
+            {
+                ParseCompilerInfo(info);
+                return probed[compiler] = std::move(info);
+            }
+        }
+
+        CompilerInfo& ret = probed[compiler] = RunProbe(compiler, path);
+        std::string out = ProbeMagic;
+        WriteValue<uint32_t>(out, ProbeVersion);
+        out += kept;
+        WriteCompilerInfo(out, ret, writeTime);
+
+        // written aside and renamed over, so two builds probing at once do not read each other's half file
+        std::error_code ec;
+        std::filesystem::path temp = file.string() + ".tmp" + std::to_string((uint64_t)std::hash<std::thread::id>()(std::this_thread::get_id()) ^ (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count());
+        std::ofstream(temp, std::ios::binary) << out;
+        std::filesystem::rename(temp, file, ec);
+        if (ec) std::filesystem::remove(temp, ec);
+        return ret;
+    }
+
+
+// --------------------------- OBJECT CACHE -----------------------------
+
+    bool CloneFile(const std::filesystem::path& from, const std::filesystem::path& to)
+    {
+        std::error_code ec;
+        std::filesystem::remove(to, ec);
+
+    #if defined(__linux__) && defined(FICLONE)
+        int in = open(from.c_str(), O_RDONLY);
+        if (in >= 0)
+        {
+            int out = open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            bool cloned = out >= 0 && ioctl(out, FICLONE, in) == 0;
+            if (out >= 0) close(out);
+            close(in);
+            if (cloned) return true;
+            std::filesystem::remove(to, ec);
+        }
+    #endif
+
+        std::filesystem::create_hard_link(from, to, ec);
+        if (!ec) return true;
+
+        return std::filesystem::copy_file(from, to, std::filesystem::copy_options::overwrite_existing, ec) && !ec;
+    }
+
+    std::string CompilerIdentity(const std::string& compiler)
+    {
+        return compiler + "\n" + ProbeCompiler(compiler).identity;
+    }
+
+    std::filesystem::path CacheEntry(const std::filesystem::path& directory, uint64_t key)
+    {
+        char name[17];
+        std::snprintf(name, sizeof(name), "%016llx", (unsigned long long)key);
+        return directory / std::string(name, 2) / (std::string(name) + ".obj");
+    }
+
+    bool ObjectCache::GetKey(const Command& cmd, uint64_t& key)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = keys.find(cmd.text);
+            if (it != keys.end())
+            {
+                key = it->second;
+                return true;
+            }
+        }
+
+        std::vector<std::string> args = SplitArguments(cmd.text);
+        if (args.empty() || UsesModules(cmd)) return false;  // the modules it imports do not show in the preprocessed source
+
+        // leave out everything that only names an output, so the same source and flags hash the same
+        // wherever the object goes
+        std::vector<std::string> preprocess;
+        std::string normalized;
+        for (size_t i = 0; i < args.size(); i++)
+        {
+            const std::string& arg = args[i];
+            if (arg == "-o" || arg == "-MF") { i++; continue; }
+            if (arg.rfind("-fprofile-use", 0) == 0) return false;  // the profile does not show in the preprocessed source
+            if (arg == "-gsplit-dwarf") return false;  // the cache would restore the object without its .dwo
+            if (arg == "-MMD" || arg == "-showIncludes" || arg.rfind("-Fo", 0) == 0 || arg.rfind("/Fo", 0) == 0) continue;
+
+            normalized += arg + "\n";
+            if (arg == "-include-pch" && i + 1 < args.size())
+            {
+                // the pch would hide the header's contents from the hash, so include the header it was built from
+                preprocess.push_back("-include");
+                preprocess.push_back(std::filesystem::path(args[++i]).replace_extension("").string());
+            }
+            else if (arg != "-c") preprocess.push_back(arg);
+        }
+        preprocess.push_back("-E");
+
+        ProcessResult result = RunProcess(preprocess, cmd.path);
+        if (result.exitCode != 0) return false;  // let the real compile report the error
+
+        key = HashBytes(result.output.data(), result.output.size(), HashString(normalized + CompilerIdentity(args[0])));
+
+        std::lock_guard<std::mutex> lock(mutex);
+        keys[cmd.text] = key;
+        return true;
+    }
+
+    bool ObjectCache::Fetch(uint64_t key, std::filesystem::path object, std::filesystem::path dependencyFile)
+    {
+        std::filesystem::path entry = CacheEntry(directory, key);
+        std::filesystem::path entryDeps = std::filesystem::path(entry).replace_extension(".d");
+        std::error_code ec;
+        if (!std::filesystem::is_regular_file(entry, ec) || (dependencyFile != "" && !std::filesystem::is_regular_file(entryDeps, ec)))
+        {
+            if (!remote) return false;
+            Prefetch({ key });
+            if (!std::filesystem::is_regular_file(entry, ec)) return false;
+        }
+
+        if (!CloneFile(entry, object) || (dependencyFile != "" && !CloneFile(entryDeps, dependencyFile)))
+        {
+            return false;
+        }
+
+        std::filesystem::last_write_time(entry, std::filesystem::file_time_type::clock::now(), ec);  // the LRU order, for Trim
+        return true;
+    }
+
+    bool ObjectCache::Contains(uint64_t key)
+    {
+        std::error_code ec;
+        return std::filesystem::is_regular_file(CacheEntry(directory, key), ec);
+    }
+
+    void ObjectCache::Store(uint64_t key, std::filesystem::path object, std::filesystem::path dependencyFile)
+    {
+        std::filesystem::path entry = CacheEntry(directory, key);
+        std::error_code ec;
+        std::filesystem::create_directories(entry.parent_path(), ec);
+
+        // copy under temporary names and rename, so a parallel Fetch never sees half an entry. The
+        // object goes last because its presence is what makes the entry valid.
+        std::string suffix = ".tmp" + std::to_string(HashString(object.string()));
+        std::filesystem::path tempObject = entry.string() + suffix;
+        std::filesystem::path tempDeps = std::filesystem::path(entry).replace_extension(".d").string() + suffix;
+        if (dependencyFile != "")
+        {
+            std::filesystem::copy_file(dependencyFile, tempDeps, std::filesystem::copy_options::overwrite_existing, ec);
+            std::filesystem::rename(tempDeps, std::filesystem::path(entry).replace_extension(".d"), ec);
+        }
+        std::filesystem::copy_file(object, tempObject, std::filesystem::copy_options::overwrite_existing, ec);
+        std::filesystem::rename(tempObject, entry, ec);
+
+        if (!ec)
+        {
+            storedBytes += std::filesystem::file_size(entry, ec);
+        }
+
+        if (remote && !ec)
+        {
+            // one blob per entry: the object's size, the object, then the dependency file
+            std::string blob;
+            for (const std::filesystem::path& file : { object, dependencyFile })
+            {
+                std::ifstream in(file, std::ios::binary);
+                std::string content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+                if (blob == "") WriteValue<uint64_t>(blob, content.size());
+                blob += content;
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            uploads.push_back({ entry.stem().string(), blob });
+            if (!uploader.joinable())
+            {
+                uploader = std::thread(&ObjectCache::Upload, this);
+            }
+            uploadsChanged.notify_all();
+        }
+    }
+
+    void ObjectCache::Prefetch(const std::vector<uint64_t>& keys)
+    {
+        if (!remote || directory == "") return;
+
+        std::vector<std::string> names;
+        std::error_code ec;
+        std::vector<uint64_t> asked;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (uint64_t key : keys)
+            {
+                if (!remoteMisses.count(key) && !std::filesystem::is_regular_file(CacheEntry(directory, key), ec))
+                {
+                    names.push_back(CacheEntry(directory, key).stem().string());
+                    asked.push_back(key);
+                }
+            }
+        }
+        if (names.empty()) return;
+
+        std::vector<std::optional<std::string>> blobs = remote->Get(names);
+        for (size_t i = 0; i < names.size() && i < blobs.size(); i++)
+        {
+            if (!blobs[i] || blobs[i]->size() < sizeof(uint64_t))
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                remoteMisses.insert(asked[i]);
+                continue;
+            }
+
+            uint64_t objectSize = 0;
+            std::memcpy(&objectSize, blobs[i]->data(), sizeof(uint64_t));
+            if (objectSize > blobs[i]->size() - sizeof(uint64_t)) continue;
+
+            // same temporary-then-rename order as Store
+            std::filesystem::path entry = CacheEntry(directory, asked[i]);
+            std::filesystem::create_directories(entry.parent_path(), ec);
+            std::string temp = ".download" + std::to_string(HashString(names[i]) ^ (uint64_t)std::hash<std::thread::id>()(std::this_thread::get_id()));
+            std::ofstream(std::filesystem::path(entry).replace_extension(".d").string() + temp, std::ios::binary) << blobs[i]->substr(sizeof(uint64_t) + objectSize);
+            std::ofstream(entry.string() + temp, std::ios::binary) << blobs[i]->substr(sizeof(uint64_t), objectSize);
+            std::filesystem::rename(std::filesystem::path(entry).replace_extension(".d").string() + temp, std::filesystem::path(entry).replace_extension(".d"), ec);
+            std::filesystem::rename(entry.string() + temp, entry, ec);
+            storedBytes += objectSize;
+        }
+    }
+
+    void ObjectCache::Upload()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true)
+        {
+            uploadsChanged.wait(lock, [this]() { return stopping || !uploads.empty(); });
+            if (uploads.empty()) return;
+
+            // send everything queued so far as one pipelined batch
+            std::vector<std::pair<std::string, std::string>> batch;
+            batch.swap(uploads);
+            uploading = true;
+            lock.unlock();
+            remote->Put(batch);
+            lock.lock();
+            uploading = false;
+            uploadsChanged.notify_all();
+        }
+    }
+
+    void ObjectCache::FinishUploads()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!uploader.joinable()) return;
+        if (!uploads.empty() || uploading) Log("Waiting for uploads to the remote cache.\n", LogType::Info);
+        uploadsChanged.wait(lock, [this]() { return uploads.empty() && !uploading; });
+    }
+
+    void ObjectCache::ForgetKeys()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        keys.clear();
+        remoteMisses.clear();
+    }
+
+    ObjectCache::ObjectCache(std::filesystem::path directory, uint64_t sizeLimit, std::string remoteUrl)
+        : directory(directory), sizeLimit(sizeLimit)
+    {
+        if (remoteUrl != "")
+        {
+            remote = std::make_shared<HttpRemoteCache>(remoteUrl);
+        }
+    }
+
+    ObjectCache::~ObjectCache()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        uploadsChanged.notify_all();
+        if (uploader.joinable())
+        {
+            uploader.join();
+        }
+    }
+
+
+// --------------------------- REMOTE CACHE -----------------------------
+
+#ifdef _WIN32
+    typedef SOCKET SocketHandle;
+    const SocketHandle InvalidSocket = INVALID_SOCKET;
+    void CloseSocket(SocketHandle socket) { closesocket(socket); }
+#else
+    typedef int SocketHandle;
+    const SocketHandle InvalidSocket = -1;
+    void CloseSocket(SocketHandle socket) { close(socket); }
+#endif
+
+    SocketHandle ConnectSocket(const std::string& host, const std::string& port, int timeoutSeconds)
+    {
+    #ifdef _WIN32
+        static bool started = []() { WSADATA data; return WSAStartup(MAKEWORD(2, 2), &data) == 0; }();
+        if (!started) return InvalidSocket;
+    #endif
+
+        addrinfo hints = {};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* found = nullptr;
+        if (getaddrinfo(host.c_str(), port.c_str(), &hints, &found) != 0) return InvalidSocket;
+
+        SocketHandle ret = InvalidSocket;
+        for (addrinfo* address = found; address != nullptr && ret == InvalidSocket; address = address->ai_next)
+        {
+            ret = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+            if (ret == InvalidSocket) continue;
+
+            // without a timeout, a server that stops answering would hang the whole build
+        #ifdef _WIN32
+            DWORD timeout = timeoutSeconds * 1000;
+        #else
+            timeval timeout = { timeoutSeconds, 0 };
+        #endif
+            setsockopt(ret, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+            setsockopt(ret, SOL_SOCKET, SO_SNDTIMEO, (const char*)&timeout, sizeof(timeout));
+            int noDelay = 1;
+            setsockopt(ret, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+
+            if (connect(ret, address->ai_addr, (int)address->ai_addrlen) != 0)
+            {
+                CloseSocket(ret);
+                ret = InvalidSocket;
+            }
+        }
+        freeaddrinfo(found);
+        return ret;
+    }
+
+    bool SendAll(SocketHandle socket, const std::string& data)
+    {
+        size_t sent = 0;
+        while (sent < data.size())
+        {
+        #ifdef MSG_NOSIGNAL
+            int flags = MSG_NOSIGNAL;  // a peer that hung up is an error, not a SIGPIPE
+        #else
+            int flags = 0;
+        #endif
+            int count = (int)send(socket, data.data() + sent, (int)std::min<size_t>(data.size() - sent, 1 << 20), flags);
+            if (count <= 0) return false;
+            sent += count;
+        }
+        return true;
+    }
+
+    bool ReceiveSome(SocketHandle socket, std::string& buffer)
+    {
+        char chunk[16384];
+        int count = (int)recv(socket, chunk, sizeof(chunk), 0);
+        if (count <= 0) return false;
+        buffer.append(chunk, count);
+        return true;
+    }
+
+    HttpRemoteCache::HttpRemoteCache(std::string url)
+    {
+        if (url.rfind("http://", 0) == 0)
+        {
+            url = url.substr(7);
+        }
+        else if (url.find("://") != std::string::npos)
+        {
+            Log("Only http:// remote caches are supported: " + url + "\n", LogType::Error);
+            unreachable = true;
+        }
+
+        size_t slash = url.find('/');
+        host = url.substr(0, slash);
+        prefix = slash == std::string::npos ? "" : url.substr(slash);
+        while (prefix != "" && prefix.back() == '/') prefix.pop_back();
+
+        size_t colon = host.rfind(':');
+        if (colon != std::string::npos && host.find(']', colon) == std::string::npos)
+        {
+            port = host.substr(colon + 1);
+            host = host.substr(0, colon);
+        }
+    }
+
+    std::vector<HttpRemoteCache::Response> HttpRemoteCache::Exchange(const std::vector<std::string>& requests)
+    {
+        std::vector<Response> ret;
+        int connects = 0;
+        const uint64_t maxBody = (uint64_t)1 << 30;  // any more is a broken server, not an object
+
+        // send every unanswered request, then read the responses in order. A server may close a
+        // keep-alive connection after any response, so reconnect and resend the rest (only a few times).
+        while (ret.size() < requests.size() && !unreachable && connects < 4)
+        {
+            SocketHandle socket = ConnectSocket(host, port, 10);
+            connects++;
+            if (socket == InvalidSocket)
+            {
+                Log("Could not reach the remote cache at " + host + ":" + port + ", it will not be used.\n", LogType::Error);
+                unreachable = true;
+                break;
+            }
+
+            std::string pending;
+            for (size_t i = ret.size(); i < requests.size(); i++)
+            {
+                pending += requests[i];
+            }
+            if (!SendAll(socket, pending))
+            {
+                CloseSocket(socket);
+                continue;
+            }
+
+            std::string buffer;
+            bool open = true;
+            while (open && ret.size() < requests.size())
+            {
+                size_t headerEnd = buffer.find("\r\n\r\n");
+                while (headerEnd == std::string::npos && (open = ReceiveSome(socket, buffer)))
+                {
+                    headerEnd = buffer.find("\r\n\r\n");
+                }
+                if (headerEnd == std::string::npos) break;
+
+                Response response;
+                std::string headers = buffer.substr(0, headerEnd + 2);
+                for (char& c : headers) c = (char)std::tolower(c);
+                size_t space = headers.find(' ');
+                response.status = space == std::string::npos ? 0 : std::atoi(headers.c_str() + space + 1);
+
+                auto header = [&](const std::string& name) -> std::string
+                    {
+                        size_t at = headers.find("\r\n" + name + ":");
+                        if (at == std::string::npos) return "";
+                        at = headers.find_first_not_of(' ', at + name.size() + 3);
+                        return headers.substr(at, headers.find("\r\n", at) - at);
+                    };
+
+                bool closing = header("connection") == "close";
+                size_t body = headerEnd + 4;
+                bool complete = false;
+
+                if (header("transfer-encoding").find("chunked") != std::string::npos)
+                {
+                    size_t at = body;
+                    while (true)
+                    {
+                        size_t lineEnd = buffer.find("\r\n", at);
+                        if (lineEnd == std::string::npos)
+                        {
+                            if (!(open = ReceiveSome(socket, buffer))) break;
+                            continue;
+                        }
+                        char* end = nullptr;
+                        uint64_t size = std::strtoull(buffer.c_str() + at, &end, 16);
+                        if (end == buffer.c_str() + at || size > maxBody - response.body.size())
+                        {
+                            CloseSocket(socket);
+                            return ret;  // the rest are misses
+                        }
+                        if (buffer.size() < lineEnd + 2 + size + 2)
+                        {
+                            if (!(open = ReceiveSome(socket, buffer))) break;
+                            continue;
+                        }
+                        response.body += buffer.substr(lineEnd + 2, size);
+                        at = lineEnd + 2 + size + 2;
+                        if (size == 0)
+                        {
+                            complete = true;
+                            body = at;
+                            break;
+                        }
+                    }
+                    // the body position is now past the last chunk
+                    if (complete) buffer.erase(0, body);
+                }
+                else
+                {
+                    std::string value = header("content-length");
+                    char* end = nullptr;
+                    uint64_t length = value == "" ? 0 : std::strtoull(value.c_str(), &end, 10);
+                    if (value != "" && (end == value.c_str() || std::strspn(end, " \t") != std::strlen(end) || length > maxBody))
+                    {
+                        CloseSocket(socket);
+                        return ret;  // the rest are misses
+                    }
+                    while (buffer.size() < body + length && (open = ReceiveSome(socket, buffer))) {}
+                    if (buffer.size() >= body + length)
+                    {
+                        response.body = buffer.substr(body, length);
+                        buffer.erase(0, body + length);
+                        complete = true;
+                    }
+                }
+
+                if (!complete) break;
+                ret.push_back(response);
+                if (closing) break;
+            }
+
+            CloseSocket(socket);
+        }
+
+        return ret;
+    }
+
+    std::vector<std::optional<std::string>> HttpRemoteCache::Get(const std::vector<std::string>& names)
+    {
+        std::vector<std::optional<std::string>> ret(names.size());
+        if (unreachable) return ret;
+
+        // a few connections, each with a slice of the names pipelined down it
+        size_t connections = std::min<size_t>(4, (names.size() + 31) / 32);
+        std::vector<std::thread> threads;
+        for (size_t c = 0; c < connections; c++)
+        {
+            threads.push_back(std::thread([&, c]()
+                {
+                    std::vector<std::string> requests;
+                    std::vector<size_t> indices;
+                    for (size_t i = c; i < names.size(); i += connections)
+                    {
+                        requests.push_back("GET " + prefix + "/" + names[i] + " HTTP/1.1\r\nHost: " + host + "\r\nConnection: keep-alive\r\n\r\n");
+                        indices.push_back(i);
+                    }
+                    std::vector<Response> responses = Exchange(requests);
+                    for (size_t i = 0; i < responses.size(); i++)
+                    {
+                        if (responses[i].status == 200) ret[indices[i]] = responses[i].body;
+                    }
+                }));
+        }
+        for (std::thread& t : threads)
+        {
+            t.join();
+        }
+        return ret;
+    }
+
+    void HttpRemoteCache::Put(const std::vector<std::pair<std::string, std::string>>& files)
+    {
+        if (unreachable) return;
+
+        std::vector<std::string> requests;
+        for (const auto& [name, data] : files)
+        {
+            requests.push_back("PUT " + prefix + "/" + name + " HTTP/1.1\r\nHost: " + host + "\r\nConnection: keep-alive\r\n"
+                "Content-Type: application/octet-stream\r\nContent-Length: " + std::to_string(data.size()) + "\r\n\r\n" + data);
+        }
+        for (Response& response : Exchange(requests))
+        {
+            if (response.status < 200 || response.status >= 300)
+            {
+                Log("The remote cache refused an upload (HTTP " + std::to_string(response.status) + ").\n", LogType::Error);
+                break;
+            }
+        }
+    }
+
+    void ObjectCache::Trim()
+    {
+        if (directory == "" || sizeLimit == 0 || storedBytes == 0) return;
+        storedBytes = 0;
+
+        struct Entry
+        {
+            std::filesystem::path path;
+            std::filesystem::file_time_type used;
+            uintmax_t size;
+        };
+        std::vector<Entry> entries;
+        uintmax_t total = 0;
+
+        std::error_code ec;
+        for (auto& file : std::filesystem::recursive_directory_iterator(directory, ec))
+        {
+            if (!file.is_regular_file(ec)) continue;
+            uintmax_t size = file.file_size(ec);
+            total += size;
+            if (file.path().extension() == ".obj")
+            {
+                entries.push_back({ file.path(), file.last_write_time(ec), size });
+            }
+        }
+
+        if (total <= sizeLimit) return;
+
+        // evict down to 90% of the limit, so the next few stores do not all trim again
+        std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.used < b.used; });
+        for (Entry& entry : entries)
+        {
+            if (total <= sizeLimit / 10 * 9) break;
+            std::filesystem::path deps = std::filesystem::path(entry.path).replace_extension(".d");
+            uintmax_t depsSize = std::filesystem::file_size(deps, ec);
+            if (ec) depsSize = 0;
+            std::filesystem::remove(deps, ec);
+            std::filesystem::remove(entry.path, ec);
+            total -= entry.size + depsSize;
+        }
+    }
+
+
+// --------------------------- REMOTE COMPILES -----------------------------
+
+    namespace
+    {
+        const char RemoteCompileMagic[] = "NOBPPRC2";
+        const int32_t RemoteCompilerMismatch = INT32_MIN;  // the exit code of a request for another compiler
+        const int32_t RemoteTokenRefused = INT32_MIN + 1;  // and of one without the worker's token
+        const int32_t RemoteFlagsRefused = INT32_MIN + 2;  // or with flags it does not run
+        const uint64_t MaxRemoteRequest = (uint64_t)64 << 20;  // a preprocessed source
+        const uint64_t MaxRemoteResponse = (uint64_t)512 << 20;  // an object with its debug info
+
+        // A new directory in temp that only this user can open, named prefix and something unique. The name
+        // is never reused, so another user of the machine cannot have put their own files or links there first.
+        // Empty if it could not be made.
+        std::filesystem::path MakePrivateDirectory(const std::string& prefix)
+        {
+            std::error_code ec;
+            std::filesystem::path temp = std::filesystem::temp_directory_path(ec);
+            if (ec) return "";
+        #ifdef _WIN32
+            static std::atomic<uint64_t> counter = 0;
+            for (int attempt = 0; attempt < 16; attempt++)
+            {
+                uint64_t unique = HashString(std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()) + "/" + std::to_string(GetCurrentProcessId())
+                    + "/" + std::to_string(GetCurrentThreadId()) + "/" + std::to_string(counter++));
+                char name[32];
+                std::snprintf(name, sizeof(name), "%016llx", (unsigned long long)unique);
+                std::filesystem::path directory = temp / (prefix + name);
+                if (CreateDirectoryW(directory.wstring().c_str(), NULL)) return directory;  // fails if anything is there already
+                if (GetLastError() != ERROR_ALREADY_EXISTS) break;
+            }
+            return "";
+        #else
+            std::string pattern = (temp / (prefix + "XXXXXX")).string();
+            if (mkdtemp(pattern.data()) == nullptr) return "";  // mode 0700, and never an existing path
+            return pattern;
+        #endif
+        }
+
+        std::string RemoteToken()
+        {
+            const char* env = std::getenv("NOBPP_REMOTE_TOKEN");
+            return env ? env : "";
+        }
+
+        // Whether a worker should run flags, checked on both ends: options that change the generated code
+        // or the diagnostics, but nothing that names a file, plugin or program for the worker's compiler to
+        // read, load or run (those would make it run whatever a client asks). Values with a path separator
+        // are refused for the same reason, so anything else can only reach the request's scratch directory.
+        bool RemoteFlagsAllowed(const std::vector<std::string>& flags)
+        {
+            auto starts = [](const std::string& arg, std::initializer_list<const char*> prefixes)
+                {
+                    for (const char* prefix : prefixes)
+                    {
+                        if (arg.rfind(prefix, 0) == 0) return true;
+                    }
+                    return false;
+                };
+            auto allowed = [&](std::string flag)
+                {
+                #if defined(__nob_msvc__)
+                    if (flag.size() < 2 || (flag[0] != '-' && flag[0] != '/')) return false;
+                    flag[0] = '-';
+                    if (flag.find_first_of("/\\", 1) != std::string::npos) return false;
+                    return !starts(flag, { "-GL", "-Zi", "-ZI" })
+                        && starts(flag, { "-O", "-EH", "-W", "-w", "-std:", "-MD", "-MT", "-G", "-Z", "-nologo", "-permissive", "-utf-8",
+                            "-source-charset:", "-execution-charset:", "-validate-charset", "-arch:", "-fp:", "-Qspectre", "-Qpar", "-Qvec",
+                            "-diagnostics:", "-J", "-bigobj", "-RTC", "-sdl", "-volatile:", "-favor:", "-guard:", "-openmp", "-constexpr:",
+                            "-external:W", "-external:anglebrackets", "-experimental:" });
+                #else
+                    if (flag.find_first_of("/\\") != std::string::npos && !starts(flag, { "-fdebug-prefix-map=", "-ffile-prefix-map=", "-fmacro-prefix-map=" })) return false;
+                    if (flag == "-w" || flag == "-ansi" || flag == "-pthread" || flag == "-pipe") return true;
+                    return !starts(flag, { "-Wl,", "-Wa,", "-Wp,", "-fplugin", "-fpass-plugin", "-fload-pass-plugin", "-fprofile", "-fauto-profile",
+                            "-fcs-profile", "-fcoverage", "-fdump", "-fopt-info", "-fsave-optimization-record", "-foptimization-record",
+                            "-fdiagnostics-add-output", "-fdiagnostics-set-output", "-fsanitize-blacklist", "-fsanitize-ignorelist",
+                            "-fsanitize-coverage-allowlist", "-fsanitize-coverage-ignorelist", "-fxray-attr-list", "-fxray-always-instrument",
+                            "-fxray-never-instrument", "-fcrash-diagnostics", "-fmodule", "-ftime-trace", "-fthinlto-index", "-fbasic-block-sections=list",
+                            "-fprebuilt-module-path", "-fembed-offload-object", "-mllvm", "-gsplit-dwarf" })
+                        && starts(flag, { "-O", "-g", "-W", "-f", "-m", "-std=", "-pedantic", "--param=" });
+                #endif
+                };
+            for (size_t i = 0; i < flags.size(); i++)
+            {
+            #if !defined(__nob_msvc__)
+                if ((flags[i] == "-target" || flags[i] == "-arch") && i + 1 < flags.size())
+                {
+                    if (flags[++i].find_first_of("/\\") != std::string::npos) return false;
+                    continue;
+                }
+                if (flags[i] == "-Xclang" && i + 1 < flags.size())
+                {
+                    i++;  // clang's own form of a driver flag, as long as it is one of the above
+                }
+            #endif
+                if (!allowed(flags[i])) return false;
+            }
+            return true;
+        }
+
+        // the compiler's version output, without the name it was run by (which can differ between machines)
+        uint64_t ToolchainHash(const std::string& compiler)
+        {
+            return HashString(ProbeCompiler(compiler).identity);
+        }
+
+        // a message is the magic and the size of its body, which is fields written by WriteValue and WriteString
+        bool SendMessage(SocketHandle socket, const std::string& body)
+        {
+            std::string header = RemoteCompileMagic;
+            WriteValue<uint64_t>(header, body.size());
+            return SendAll(socket, header) && SendAll(socket, body);
+        }
+
+        bool ReceiveMessage(SocketHandle socket, std::string& body, uint64_t limit)
+        {
+            std::string buffer;
+            while (buffer.size() < 16)
+            {
+                if (!ReceiveSome(socket, buffer)) return false;
+            }
+            uint64_t size = 0;
+            std::memcpy(&size, buffer.data() + 8, sizeof(size));
+            if (buffer.compare(0, 8, RemoteCompileMagic) != 0 || size > limit) return false;
+
+            buffer.reserve(16 + size);
+            while (buffer.size() < 16 + size)
+            {
+                if (!ReceiveSome(socket, buffer)) return false;
+            }
+            body = buffer.substr(16);
+            return body.size() == size;
+        }
+
+        void ServeRemoteCompile(SocketHandle socket, const std::string& compiler, uint64_t toolchain, const std::string& token)
+        {
+            std::string request;
+            if (!ReceiveMessage(socket, request, MaxRemoteRequest)) return;
+
+            LogReader reader{ request };
+            std::string clientToken = reader.String();
+            uint64_t clientToolchain = reader.Value<uint64_t>();
+            std::string clientDirectory = reader.String();
+            std::string sourceName = reader.String();  // only for the log
+            std::string language = reader.String();
+            std::vector<std::string> flags;
+            uint32_t count = reader.Value<uint32_t>();
+            for (uint32_t i = 0; i < count && !reader.failed; i++)
+            {
+                flags.push_back(reader.String());
+            }
+            std::string source = reader.String();
+            if (reader.failed || (language != "c" && language != "c++")) return;
+
+            std::string response;
+            auto refuse = [&](int32_t code)
+                {
+                    WriteValue<int32_t>(response, code);
+                    for (int i = 0; i < 3; i++) WriteString(response, "");
+                    SendMessage(socket, response);
+                };
+
+            unsigned char different = clientToken.size() != token.size();
+            for (size_t i = 0; i < clientToken.size() && i < token.size(); i++) different |= clientToken[i] ^ token[i];  // in constant time
+            if (different)
+            {
+                Log("Refused a compile of " + sourceName + " from " + clientDirectory + ": wrong NOBPP_REMOTE_TOKEN.\n", LogType::Error);
+                refuse(RemoteTokenRefused);
+                return;
+            }
+            if (clientToolchain != toolchain)
+            {
+                refuse(RemoteCompilerMismatch);
+                return;
+            }
+            if (!RemoteFlagsAllowed(flags))
+            {
+                Log("Refused a compile of " + sourceName + " from " + clientDirectory + ": flags outside the worker's list.\n", LogType::Error);
+                refuse(RemoteFlagsRefused);
+                return;
+            }
+
+            Log("Compiling " + sourceName + " from " + clientDirectory + "\n", LogType::Info);
+            std::vector<std::string> args = { compiler };
+            args.insert(args.end(), flags.begin(), flags.end());
+
+            std::filesystem::path directory = MakePrivateDirectory("nobpp_remote_");
+            if (directory == "")
+            {
+                Log("Could not make a directory in " + std::filesystem::temp_directory_path().string() + " for a remote compile.\n", LogType::Error);
+                return;
+            }
+            std::string input = language == "c" ? "remote.i" : "remote.ii";
+            std::ofstream(directory / input, std::ios::binary) << source;
+
+        #if defined(__nob_msvc__)
+            args.insert(args.end(), { "-c", (language == "c" ? "-Tc" : "-Tp") + input, "-Foremote.obj" });
+        #else
+            // the preprocessed source names the client's files already, this makes the debug info agree
+            args.insert(args.end(), { "-fdebug-prefix-map=" + directory.string() + "=" + clientDirectory, "-c", input, "-o", "remote.obj" });
+        #endif
+            ProcessResult result = RunProcess(args, directory);
+
+        #if defined(__nob_msvc__)
+            if (result.output.rfind(input, 0) == 0)
+            {
+                result.output = result.output.substr(std::min(result.output.find('\n'), result.output.size() - 1) + 1);  // cl's banner line
+            }
+        #endif
+
+            std::string object;
+            if (result.exitCode == 0)
+            {
+                std::ifstream in(directory / "remote.obj", std::ios::binary);
+                object.assign((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+            }
+            std::error_code ec;
+            std::filesystem::remove_all(directory, ec);
+
+            WriteValue<int32_t>(response, result.exitCode);
+            WriteString(response, result.output);
+            WriteString(response, result.errors);
+            WriteString(response, object);
+            SendMessage(socket, response);
+        }
+    }
+
+    RemoteCompilers::RemoteCompilers(std::string list) : token(RemoteToken())
+    {
+        size_t start = 0;
+        while (start < list.size())
+        {
+            size_t end = std::min(list.find(',', start), list.size());
+            if (end > start) workers.push_back(list.substr(start, end - start));
+            start = end + 1;
+        }
+    }
+
+    bool RemoteCompilers::Usable(const std::string& worker)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return dropped.count(worker) == 0;
+    }
+
+    void RemoteCompilers::Drop(const std::string& worker, const std::string& reason)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (dropped.insert(worker).second)
+        {
+            Log("Remote worker " + worker + " " + reason + ", so it gets no more compiles.\n", LogType::Info);
+        }
+    }
+
+    bool RemoteCompilers::Compile(const Command& cmd, ProcessResult& result)
+    {
+        if (workers.empty() || UsesModules(cmd)) return false;
+        std::vector<std::string> args = SplitArguments(cmd.text);
+        if (args.size() < 2) return false;
+
+        // the worker gets the command without anything that names a local file: the preprocessor writes
+        // the source and its headers into one file, and the object comes back in the response
+        auto starts = [](const std::string& arg, std::initializer_list<const char*> prefixes)
+            {
+                for (const char* prefix : prefixes)
+                {
+                    if (arg.rfind(prefix, 0) == 0) return true;
+                }
+                return false;
+            };
+        std::vector<std::string> preprocess = { args[0] };
+        std::vector<std::string> flags;
+        std::string source;
+        std::string language;
+    #if defined(__nob_msvc__)
+        for (size_t i = 1; i < args.size(); i++)
+        {
+            const std::string& arg = args[i];
+            if (starts(arg, { "-Yu", "-Yc", "-Fp", "-Zi", "-ZI", "-Fd", "-FR", "-Fr", "-GL", "-LTCG", "-interface", "-internalPartition", "-reference", "-ifc", "-sourceDependencies", "-headerUnit", "-scanDependencies", "@" }) || arg.find(":native") != std::string::npos)
+            {
+                return false;  // uses files only this machine has, or is only right for it
+            }
+            else if (arg == "-c" || starts(arg, { "-Fo" }))
+            {
+                continue;
+            }
+            else if (arg == "-TP" || arg == "-TC")
+            {
+                language = arg == "-TC" ? "c" : "c++";
+                preprocess.push_back(arg);
+            }
+            else if (starts(arg, { "-Tp", "-Tc" }))
+            {
+                language = starts(arg, { "-Tc" }) ? "c" : "c++";
+                if (source != "") return false;
+                source = arg.substr(3);
+                preprocess.push_back(arg);
+            }
+            else if (starts(arg, { "-I", "-D", "-U", "-FI", "-external:I", "-X", "-u", "-showIncludes" }))
+            {
+                preprocess.push_back(arg);
+            }
+            else if (arg[0] != '-' && arg[0] != '/')
+            {
+                if (source != "") return false;
+                source = arg;
+                if (language == "") language = std::filesystem::path(arg).extension() == ".c" ? "c" : "c++";
+                preprocess.push_back(arg);
+            }
+            else
+            {
+                preprocess.push_back(arg);
+                flags.push_back(arg);
+            }
+        }
+    #else
+        for (size_t i = 1; i < args.size(); i++)
+        {
+            const std::string& arg = args[i];
+            bool valued = i + 1 < args.size();
+            if (starts(arg, { "-fprofile", "-fauto-profile", "--coverage", "-gsplit-dwarf", "-ftime-trace", "-include", "-fplugin", "-fmodule", "-save-temps", "-MJ", "-B", "-specs", "--specs", "@" })
+                || arg.find("=native") != std::string::npos)
+            {
+                return false;  // uses files only this machine has, or is only right for it
+            }
+            else if (arg == "-c")
+            {
+                continue;
+            }
+            else if (arg == "-o" && valued)
+            {
+                i++;
+            }
+            else if ((arg == "-MF" || arg == "-MT" || arg == "-MQ" || arg == "-I" || arg == "-D" || arg == "-U" || arg == "-isystem" || arg == "-iquote"
+                || arg == "-idirafter" || arg == "-imacros" || arg == "-isysroot" || arg == "-iprefix" || arg == "-iwithprefix" || arg == "-x") && valued)
+            {
+                if (arg == "-x") language = args[i + 1];
+                preprocess.push_back(arg);
+                preprocess.push_back(args[++i]);
+            }
+            else if (starts(arg, { "-M", "-I", "-D", "-U", "-isystem", "-iquote", "-idirafter", "-imacros", "-isysroot", "--sysroot", "-iprefix", "-iwithprefix", "-nostdinc" }))
+            {
+                preprocess.push_back(arg);
+            }
+            else if ((arg == "-Xclang" || arg == "-target" || arg == "-arch" || arg == "-mllvm" || arg == "-Xassembler") && valued)
+            {
+                preprocess.insert(preprocess.end(), { arg, args[i + 1] });
+                flags.insert(flags.end(), { arg, args[++i] });
+            }
+            else if (arg[0] != '-')
+            {
+                if (source != "") return false;
+                source = arg;
+                preprocess.push_back(arg);
+            }
+            else
+            {
+                preprocess.push_back(arg);
+                flags.push_back(arg);
+            }
+        }
+        if (language == "") language = std::filesystem::path(source).extension() == ".c" ? "c" : "c++";
+        preprocess.push_back("-E");  // -MMD -MF still write the .d file
+    #endif
+        if (source == "" || (language != "c" && language != "c++") || !RemoteFlagsAllowed(flags)) return false;
+
+        auto startTime = std::chrono::steady_clock::now();
+    #if defined(__nob_msvc__)
+        std::filesystem::path scratch = MakePrivateDirectory("nobpp_remote_");  // cl writes the preprocessed source to a file
+        if (scratch == "") return false;
+        std::filesystem::path preprocessed = scratch / "remote.i";
+        preprocess.insert(preprocess.end(), { "-P", "-Fi" + preprocessed.string() });
+    #endif
+        ProcessResult local = RunProcess(preprocess, cmd.path);
+    #if defined(__nob_msvc__)
+        std::string deps = TakeShowIncludes(local.output);
+        {
+            std::ifstream in(preprocessed, std::ios::binary);
+            local.output.assign((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        }
+        std::error_code ec;
+        std::filesystem::remove_all(scratch, ec);
+    #endif
+        if (local.exitCode != 0) return false;  // the local compile reports the error properly
+
+        std::string request;
+        WriteString(request, token);
+        WriteValue<uint64_t>(request, ToolchainHash(args[0]));
+        WriteString(request, std::filesystem::absolute(cmd.path).string());
+        WriteString(request, source);
+        WriteString(request, language);
+        WriteValue<uint32_t>(request, (uint32_t)flags.size());
+        for (const std::string& flag : flags) WriteString(request, flag);
+        WriteString(request, local.output);
+
+        for (size_t attempt = 0; attempt < workers.size(); attempt++)
+        {
+            std::string worker = workers[next++ % workers.size()];
+            if (!Usable(worker)) continue;
+
+            size_t colon = worker.rfind(':');
+            std::string host = worker.substr(0, colon);
+            if (host.size() > 1 && host.front() == '[' && host.back() == ']') host = host.substr(1, host.size() - 2);
+            SocketHandle socket = colon == std::string::npos ? InvalidSocket : ConnectSocket(host, worker.substr(colon + 1), 600);
+            if (socket == InvalidSocket)
+            {
+                Drop(worker, "is unreachable");
+                continue;
+            }
+
+            std::string response;
+            bool answered = SendMessage(socket, request) && ReceiveMessage(socket, response, MaxRemoteResponse);
+            CloseSocket(socket);
+            if (!answered)
+            {
+                Log("Remote worker " + worker + " did not answer, compiling " + source + " locally.\n", LogType::Info);
+                return false;
+            }
+
+            LogReader reader{ response };
+            int32_t exitCode = reader.Value<int32_t>();
+            std::string output = reader.String();
+            std::string errors = reader.String();
+            std::string object = reader.String();
+            if (reader.failed) return false;
+            if (exitCode == RemoteCompilerMismatch)
+            {
+                Drop(worker, "has a different " + args[0]);
+                continue;
+            }
+            if (exitCode == RemoteTokenRefused)
+            {
+                Drop(worker, "refused NOBPP_REMOTE_TOKEN");
+                continue;
+            }
+            if (exitCode == RemoteFlagsRefused) return false;  // an older or stricter worker
+
+            if (exitCode == 0)
+            {
+                std::ofstream out(cmd.outputs[0].path, std::ios::binary);
+                out << object;
+                if (!out) return false;
+            #if defined(__nob_msvc__)
+                std::ofstream(cmd.dependencyFile) << cmd.dependencyFile.stem().string() << ".obj: \\\n" << deps << "\n";
+            #endif
+            }
+
+            result = ProcessResult{};
+            result.exitCode = exitCode;
+            result.output = output;
+            result.errors = local.errors + errors;  // the preprocessor's #warnings, then the compiler's
+            result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+            return true;
+        }
+        return false;
+    }
+
+    int ServeRemoteCompiles(std::string port, std::string compiler, std::string address)
+    {
+        if (compiler == "")
+        {
+            std::vector<std::string> args = SplitArguments(DefaultCompileCommand.text);
+            if (!args.empty()) compiler = args[0];
+        }
+        uint64_t toolchain = ToolchainHash(compiler);
+
+    #ifdef _WIN32
+        static bool started = []() { WSADATA data; return WSAStartup(MAKEWORD(2, 2), &data) == 0; }();
+        if (!started) return 1;
+    #endif
+
+        addrinfo hints = {};
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = AI_PASSIVE;
+        addrinfo* found = nullptr;
+        SocketHandle listener = InvalidSocket;
+        for (int family : { AF_INET6, AF_INET })
+        {
+            hints.ai_family = family;
+            if (getaddrinfo(address == "" ? nullptr : address.c_str(), port.c_str(), &hints, &found) != 0) continue;
+            listener = socket(found->ai_family, found->ai_socktype, found->ai_protocol);
+            if (listener != InvalidSocket)
+            {
+                int off = 0;
+                if (family == AF_INET6) setsockopt(listener, IPPROTO_IPV6, IPV6_V6ONLY, (const char*)&off, sizeof(off));  // so it takes IPv4 too
+            #ifndef _WIN32
+                int on = 1;
+                setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, (const char*)&on, sizeof(on));  // restarting a worker should not wait out TIME_WAIT
+            #endif
+                if (bind(listener, found->ai_addr, (int)found->ai_addrlen) != 0 || listen(listener, 64) != 0)
+                {
+                    CloseSocket(listener);
+                    listener = InvalidSocket;
+                }
+            }
+            freeaddrinfo(found);
+            if (listener != InvalidSocket) break;
+        }
+        if (listener == InvalidSocket)
+        {
+            Log("Could not listen for remote compiles on " + (address == "" ? std::string("port ") : address + ":") + port + ".\n", LogType::Error);
+            return 1;
+        }
+
+        std::string token = RemoteToken();
+        Log("Serving " + compiler + " compiles on " + (address == "" ? std::string("port ") : address + ":") + port + ".\n", LogType::Info);
+        if (token == "" && address != "127.0.0.1" && address != "::1" && address != "localhost")
+        {
+            Log("NOBPP_REMOTE_TOKEN is not set, so anyone who can reach this port can send compiles.\n", LogType::Info);
+        }
+        while (true)
+        {
+            SocketHandle client = accept(listener, nullptr, nullptr);
+            if (client == InvalidSocket) continue;
+
+            // a client that stops sending halfway should not hold a job forever
+        #ifdef _WIN32
+            DWORD timeout = 600 * 1000;
+        #else
+            timeval timeout = { 600, 0 };
+        #endif
+            setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+            setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, (const char*)&timeout, sizeof(timeout));
+
+            DefaultJobPool.Submit([=]()
+                {
+                    ServeRemoteCompile(client, compiler, toolchain, token);
+                    CloseSocket(client);
+                    return 0;
+                });
+        }
+    }
+
+
+// ------------------------ CORE HELPER FUNCTIONS -------------------------
+
+    namespace
+    {
+        thread_local bool IsPoolWorker = false;
+
+        // GNU make's jobserver: a process may always run one job, and runs each one beyond that with a token,
+        // a byte read from a pipe or fifo (a count of a named semaphore on Windows) and given back after
+        class JobServer
+        {
+        public:
+            JobServer()
+            {
+                if (!NOBPP_JOBSERVER) return;
+                const char* env = std::getenv("MAKEFLAGS");
+                std::string flags = env == nullptr ? "" : env;
+                std::string auth = Option(flags, "--jobserver-auth=");
+                if (auth == "") auth = Option(flags, "--jobserver-fds=");  // make before 4.2
+                if (auth == "")
+                {
+                    Create(flags);
+                }
+                else if (Open(auth))
+                {
+                    // the tokens bound the jobs, so there are as many workers as make's -j could let run
+                    for (size_t start = 0; start < flags.size();)
+                    {
+                        size_t end = std::min(flags.find(' ', start), flags.size());
+                        if (flags.compare(start, 2, "-j") == 0 && start + 2 < end && std::isdigit((unsigned char)flags[start + 2]))
+                        {
+                            JobCount = std::max(std::atoi(flags.c_str() + start + 2), 1);
+                        }
+                        start = end + 1;
+                    }
+                    Log("Sharing jobs with the jobserver in MAKEFLAGS (-j" + std::to_string(JobCount) + ").\n", LogType::Info);
+                }
+                else
+                {
+                    Log("MAKEFLAGS names a jobserver this process cannot use (is the make rule missing a +?), so -j only counts this build.\n", LogType::Info);
+                }
+            }
+
+            bool Active() const { return active; }
+
+            // waits for a job slot, and returns false when it got this process's own one instead of a token
+            bool Acquire(char& token)
+            {
+                while (true)
+                {
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        if (!ownSlotTaken)
+                        {
+                            ownSlotTaken = true;
+                            return false;
+                        }
+                    }
+                    // a short wait, so a job finishing here gets its slot back to the next one
+#ifdef _WIN32
+                    if (WaitForSingleObject(semaphore, 100) == WAIT_OBJECT_0)
+                    {
+                        token = '+';
+                        return true;
+                    }
+#else
+                    pollfd ready = { readFd, POLLIN, 0 };
+                    if (poll(&ready, 1, 100) > 0 && read(readFd, &token, 1) == 1) return true;
+#endif
+                }
+            }
+
+            void Release(bool taken, char token)
+            {
+                if (!taken)
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    ownSlotTaken = false;
+                    return;
+                }
+#ifdef _WIN32
+                ReleaseSemaphore(semaphore, 1, NULL);
+#else
+                while (write(writeFd, &token, 1) < 0 && errno == EINTR) {}
+#endif
+            }
+
+        private:
+            static std::string Option(const std::string& flags, const std::string& name)  // the last one counts
+            {
+                size_t pos = flags.rfind(name);
+                if (pos == std::string::npos) return "";
+                pos += name.size();
+                return flags.substr(pos, flags.find(' ', pos) - pos);
+            }
+
+            bool Open(const std::string& auth)
+            {
+#ifdef _WIN32
+                semaphore = OpenSemaphoreA(SEMAPHORE_MODIFY_STATE | SYNCHRONIZE, FALSE, auth.c_str());
+                active = semaphore != NULL;
+#else
+                if (auth.rfind("fifo:", 0) == 0)
+                {
+                    // make 4.4 hands out a named pipe, which this opens without blocking of its own
+                    std::string path = auth.substr(5);
+                    readFd = open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+                    writeFd = readFd < 0 ? -1 : open(path.c_str(), O_WRONLY | O_CLOEXEC);
+                    active = readFd >= 0 && writeFd >= 0;
+                    return active;
+                }
+
+                int readEnd = -1;
+                int writeEnd = -1;
+                if (std::sscanf(auth.c_str(), "%d,%d", &readEnd, &writeEnd) != 2 || fcntl(readEnd, F_GETFD) < 0 || fcntl(writeEnd, F_GETFD) < 0) return false;
+                readFd = NonBlockingReader(readEnd);
+                writeFd = writeEnd;
+                active = true;
+#endif
+                return active;
+            }
+
+            void Create(std::string flags)
+            {
+                unsigned int tokens = std::max(JobCount, 1u) - 1;
+                std::string auth;
+#ifdef _WIN32
+                auth = "nobpp_jobserver_" + std::to_string(GetCurrentProcessId());
+                semaphore = CreateSemaphoreA(NULL, (LONG)tokens, (LONG)std::max(tokens, 1u), auth.c_str());
+                if (semaphore == NULL) return;
+#else
+                int fds[2];
+                if (pipe(fds) != 0) return;  // inherited by every child, like make's own
+                std::string bytes(tokens, '+');
+                if (write(fds[1], bytes.data(), bytes.size()) != (ssize_t)bytes.size())
+                {
+                    close(fds[0]);
+                    close(fds[1]);
+                    return;
+                }
+                readFd = NonBlockingReader(fds[0]);
+                writeFd = fds[1];
+                auth = std::to_string(fds[0]) + "," + std::to_string(fds[1]);
+#endif
+                active = true;
+                flags += (flags == "" ? "" : " ") + std::string("-j") + std::to_string(std::max(JobCount, 1u)) + " --jobserver-auth=" + auth;
+#ifdef _WIN32
+                _putenv_s("MAKEFLAGS", flags.c_str());
+#else
+                setenv("MAKEFLAGS", flags.c_str(), 1);
+#endif
+            }
+
+#ifndef _WIN32
+            // Another process could take the token between poll and read, which would block a shared pipe.
+            // Linux can open the pipe again as a description of this process's own, which does not block.
+            static int NonBlockingReader(int fd)
+            {
+#if defined(__linux__)
+                int own = open(("/proc/self/fd/" + std::to_string(fd)).c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+                if (own >= 0) return own;
+#endif
+                return fd;
+            }
+
+            int readFd = -1;
+            int writeFd = -1;
+#else
+            HANDLE semaphore = NULL;
+#endif
+            bool active = false;
+            bool ownSlotTaken = false;
+            std::mutex mutex;
+        };
+
+        JobServer& Jobs()
+        {
+            static JobServer* jobs = new JobServer();  // leaked, so workers still running at exit can give their tokens back
+            return *jobs;
+        }
+    }
+
+    JobPool::~JobPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& t : workers)
+        {
+            t.join();
+        }
+    }
+
+    std::shared_future<int> JobPool::Submit(std::function<int()> job, double priority, uint64_t memory, bool isLink)
+    {
+        Job next{ std::packaged_task<int()>([this, job]() { return failed ? Cancelled : job(); }), {}, priority, memory, isLink };
+        next.result = next.task.get_future().share();
+        std::shared_future<int> ret = next.result;
+
+        if (IsPoolWorker)
+        {
+            // a job waiting on its own pool would deadlock once every worker did the same
+            next.task();
+            return ret;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (workers.empty())
+            {
+                for (unsigned int i = 0; i < std::max(JobCount, 1u); i++)
+                {
+                    workers.push_back(std::thread(&JobPool::Work, this));
+                }
+            }
+            auto at = std::upper_bound(queue.begin(), queue.end(), priority, [](double p, const Job& queued) { return p > queued.priority; });
+            queue.insert(at, std::move(next));
+            Sink().Progress(finished, ++submitted);
+        }
+        wake.notify_one();
+        return ret;
+    }
+
+    std::shared_future<int> JobPool::Submit(Command cmd, bool suppressOutput, double priority)
+    {
+        return Submit(std::function<int()>([cmd, suppressOutput]() mutable { return cmd.Run(suppressOutput); }), priority, EstimateMemory(cmd), cmd.kind == CommandKind::Link);
+    }
+
+    uint64_t EstimateMemory(const Command& cmd)
+    {
+        if (cmd.memory != 0 || cmd.outputs.empty()) return cmd.memory;
+
+        BuildRecord record;
+        return DefaultBuildLog.Find(cmd.outputs[0].path, record) ? record.peakMemory : 0;
+    }
+
+    uint64_t AvailableMemory()
+    {
+    #if defined(_WIN32)
+        MEMORYSTATUSEX status = {};
+        status.dwLength = sizeof(status);
+        return GlobalMemoryStatusEx(&status) ? status.ullAvailPhys : UINT64_MAX;
+    #elif defined(__linux__)
+        // MemAvailable counts the page cache that can be dropped, unlike the free page count
+        std::ifstream meminfo("/proc/meminfo");
+        std::string name;
+        uint64_t kilobytes = 0;
+        while (meminfo >> name >> kilobytes)
+        {
+            if (name == "MemAvailable:") return kilobytes * 1024;
+            meminfo.ignore(64, '\n');
+        }
+        return UINT64_MAX;
+    #elif defined(_SC_AVPHYS_PAGES)
+        long pages = sysconf(_SC_AVPHYS_PAGES);
+        return pages > 0 ? (uint64_t)pages * sysconf(_SC_PAGESIZE) : UINT64_MAX;
+    #else
+        long pages = sysconf(_SC_PHYS_PAGES);  // macOS only reports the total
+        return pages > 0 ? (uint64_t)pages * sysconf(_SC_PAGESIZE) / 2 : UINT64_MAX;
+    #endif
+    }
+
+    std::vector<double> EstimateDurations(const std::vector<const Command*>& cmds)
+    {
+        std::vector<double> ret(cmds.size(), -1.0);
+        std::vector<uintmax_t> bytes(cmds.size(), 0);
+        double knownSeconds = 0.0;
+        uintmax_t knownBytes = 0;
+
+        for (size_t i = 0; i < cmds.size(); i++)
+        {
+            std::error_code ec;
+            for (const TrackedFile& input : cmds[i]->inputs)
+            {
+                uintmax_t size = std::filesystem::file_size(input.path, ec);
+                if (!ec) bytes[i] += size;
+            }
+
+            BuildRecord record;
+            if (!cmds[i]->outputs.empty() && DefaultBuildLog.Find(cmds[i]->outputs[0].path, record))
+            {
+                ret[i] = record.seconds;
+                knownSeconds += record.seconds;
+                knownBytes += bytes[i];
+            }
+        }
+
+        // about a second per 100KB of source when nothing has been built yet
+        double secondsPerByte = knownBytes > 0 && knownSeconds > 0.0 ? knownSeconds / knownBytes : 1e-5;
+        for (size_t i = 0; i < cmds.size(); i++)
+        {
+            if (ret[i] < 0.0) ret[i] = bytes[i] * secondsPerByte;
+        }
+        return ret;
+    }
+
+    int JobPool::Wait()
+    {
+        if (IsPoolWorker)
+        {
+            return 0;  // nested jobs already ran inline
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        idle.wait(lock, [this]() { return queue.empty() && running == 0; });
+        int ret = result;
+        result = 0;
+        return ret;
+    }
+
+    void JobPool::Count(int result)
+    {
+        if (result != 0 && result != Cancelled && ++failures == FailureLimit)
+        {
+            failed = true;
+            Log("Stopping the build after " + std::to_string(failures) + (failures == 1 ? " failed command" : " failed commands") + " (-k 0 keeps going).\n", LogType::Error);
+            if (KillOnFailure) TerminateChildren();
+        }
+    }
+
+    bool JobPool::Report(int result)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Count(result);
+        return !failed;
+    }
+
+    void JobPool::ClearFailures()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        failures = 0;
+        failed = false;
+    }
+
+    bool JobPool::Fits(const Job& job)
+    {
+        if (job.isLink && LinkJobCount > 0 && runningLinks >= LinkJobCount) return false;
+        return running == 0 || reservedMemory + job.memory <= MemoryBudget;  // a job bigger than the budget still runs alone
+    }
+
+    void JobPool::Work()
+    {
+        IsPoolWorker = true;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true)
+        {
+            // the first queued job that fits, so a heavy job waits for memory without holding up the small ones
+            auto next = queue.end();
+            wake.wait(lock, [&]()
+                {
+                    next = std::find_if(queue.begin(), queue.end(), [this](const Job& job) { return Fits(job); });
+                    return next != queue.end() || (stopping && queue.empty());
+                });
+            if (next == queue.end())
+            {
+                return;
+            }
+
+            Job job = std::move(*next);
+            queue.erase(next);
+            running++;
+            reservedMemory += job.memory;
+            if (job.isLink) runningLinks++;
+
+            lock.unlock();
+            JobServer& jobs = Jobs();
+            char token = 0;
+            bool acquire = jobs.Active() && !failed;  // a job that will only return Cancelled needs no make token
+            bool taken = acquire && jobs.Acquire(token);
+            job.task();
+            if (acquire) jobs.Release(taken, token);
+            int ret = -1;
+            try { ret = job.result.get(); } catch (...) {}
+            lock.lock();
+
+            running--;
+            reservedMemory -= job.memory;
+            if (job.isLink) runningLinks--;
+            if (result == 0) result = ret;
+            Count(ret);
+            finished++;
+            if (queue.empty() && running == 0)
+            {
+                submitted = finished = 0;
+                idle.notify_all();
+            }
+            Sink().Progress(finished, submitted);
+            wake.notify_all();  // the memory or link slot it held may let a waiting job start
+        }
+    }
+
+
+    size_t BuildGraph::Add(Command cmd)
+    {
+        nodes.push_back(cmd);
+        return nodes.size() - 1;
+    }
+
+    void BuildGraph::AddDependency(size_t node, size_t dependsOn)
+    {
+        extraDependencies.push_back({ node, dependsOn });
+    }
+
+    int BuildGraph::Run(bool suppressOutput)
+    {
+        auto key = [](const std::filesystem::path& file) { return std::filesystem::absolute(file).lexically_normal().string(); };
+
+        std::unordered_map<std::string, size_t> producers;
+        for (size_t i = 0; i < nodes.size(); i++)
+        {
+            for (TrackedFile& output : nodes[i].outputs)
+            {
+                auto [it, added] = producers.insert({ key(output.path), i });
+                if (!added && it->second != i)
+                {
+                    Log("Two commands in the build graph output " + output.path.string() + "\n", LogType::Error);
+                    return 1;
+                }
+            }
+        }
+
+        // edges from each producer to the commands that read its outputs
+        std::vector<std::vector<size_t>> dependents(nodes.size());
+        std::vector<size_t> waiting(nodes.size(), 0);
+        auto connect = [&](size_t node, size_t dependsOn)
+            {
+                if (node == dependsOn || std::find(dependents[dependsOn].begin(), dependents[dependsOn].end(), node) != dependents[dependsOn].end()) return;
+                dependents[dependsOn].push_back(node);
+                waiting[node]++;
+            };
+        for (size_t i = 0; i < nodes.size(); i++)
+        {
+            for (TrackedFile& input : nodes[i].inputs)
+            {
+                auto it = producers.find(key(input.path));
+                if (it != producers.end()) connect(i, it->second);
+            }
+        }
+        for (auto [node, dependsOn] : extraDependencies)
+        {
+            if (node < nodes.size() && dependsOn < nodes.size()) connect(node, dependsOn);
+        }
+
+        // a node's priority is the longest chain of estimated time from it to the end of the build,
+        // so the pool starts the long poles first
+        std::vector<const Command*> pointers;
+        for (Command& node : nodes) pointers.push_back(&node);
+        std::vector<double> durations = EstimateDurations(pointers);
+        std::vector<double> priorities(nodes.size(), -1.0);
+        std::function<double(size_t, size_t)> criticalPath = [&](size_t i, size_t depth)
+            {
+                if (priorities[i] >= 0.0 || depth > nodes.size()) return std::max(priorities[i], 0.0);  // the depth check stops cycles
+                double longest = 0.0;
+                for (size_t next : dependents[i]) longest = std::max(longest, criticalPath(next, depth + 1));
+                return priorities[i] = durations[i] + longest;
+            };
+        for (size_t i = 0; i < nodes.size(); i++) criticalPath(i, 0);
+
+        std::mutex mutex;
+        std::condition_variable changed;
+        std::deque<std::pair<size_t, int>> finished;
+        std::vector<char> blocked(nodes.size(), 0);
+        size_t remaining = nodes.size();
+        size_t running = 0;
+        size_t skipped = 0;
+        int ret = 0;
+
+        // jobs only report back here, so the scheduling all happens on this thread
+        auto start = [&](size_t i)
+            {
+                running++;
+                DefaultJobPool.Submit(std::function<int()>([&, i]()
+                    {
+                        int result = nodes[i].Run(suppressOutput);
+                        {
+                            std::lock_guard<std::mutex> lock(mutex);
+                            finished.push_back({ i, result });
+                        }
+                        changed.notify_one();
+                        return result;
+                    }), priorities[i], EstimateMemory(nodes[i]), nodes[i].kind == CommandKind::Link);
+            };
+
+        for (size_t i = 0; i < nodes.size(); i++)
+        {
+            if (waiting[i] == 0) start(i);
+        }
+
+        while (remaining > 0)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (finished.empty() && running == 0)
+            {
+                Log("The build graph has a cycle, " + std::to_string(remaining) + " commands were not run.\n", LogType::Error);
+                return ret == 0 ? 1 : ret;
+            }
+            changed.wait(lock, [&]() { return !finished.empty(); });
+            auto [node, result] = finished.front();
+            finished.pop_front();
+            lock.unlock();
+
+            running--;
+            std::vector<std::pair<size_t, bool>> done = { { node, result == 0 } };
+            while (!done.empty())
+            {
+                auto [i, succeeded] = done.back();
+                done.pop_back();
+                remaining--;
+                if (!succeeded && ret == 0) ret = result;
+
+                for (size_t next : dependents[i])
+                {
+                    if (!succeeded) blocked[next] = true;
+                    if (--waiting[next] > 0) continue;
+
+                    if (blocked[next])
+                    {
+                        done.push_back({ next, false });  // skip everything downstream of the failure
+                        skipped++;
+                    }
+                    else
+                    {
+                        start(next);
+                    }
+                }
+            }
+        }
+
+        if (skipped > 0)
+        {
+            Log(std::to_string(skipped) + " commands were not run because a command before them failed.\n", LogType::Error);
+        }
+        return ret;
+    }
+
+
+    std::string AddEscapes(std::string inp)
+    {
+        std::string ret = "";
+        for (int i = 0; i < inp.size(); i++)
+        {
+            switch (inp[i])
+            {
+            case '\'': ret += "\\\'"; break;
             case '\"': ret += "\\\""; break;
             case '\?': ret += "\\\?"; break;
             case '\\': ret += "\\\\"; break;
@@ -465,565 +4762,1834 @@ namespace nob
             default: ret += inp[i]; break;
             }
         }
-        return ret;
-    }
+        return ret;
+    }
+
+    std::string RemoveEscapes(std::string inp)
+    {
+        std::string ret = "";
+        for (int i = 0; i < inp.size(); i++)
+        {
+            if (inp[i] == '\\')
+            {
+                i++;
+                switch (inp[i])
+                {
+                case '\'': ret += "\'"; break;
+                case '\"': ret += "\""; break;
+                case '\?': ret += "\?"; break;
+                case '\\': ret += "\\"; break;
+                case '\a': ret += "a"; break;
+                case '\b': ret += "b"; break;
+                case '\f': ret += "f"; break;
+                case '\n': ret += "n"; break;
+                case '\r': ret += "r"; break;
+                case '\t': ret += "t"; break;
+                case '\v': ret += "v"; break;
+                default: Log("Error: unrecognized escape code cannot be removed."); break;
+                }
+            }
+            else
+            {
+                ret += inp[i];
+            }
+        }
+        return ret;
+    }
+
+
+    std::vector<std::filesystem::path> ParseDependencyFile(std::filesystem::path file)
+    {
+        std::ifstream in(file, std::ios::binary);
+        std::string content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+        // split into lines of words, where "\ " is a space in a path, "$$" is a dollar and "\<newline>" continues the line
+        std::vector<std::vector<std::string>> lines(1);
+        std::string current;
+        for (size_t i = 0; i < content.size(); i++)
+        {
+            char c = content[i];
+            if (c == '\\' && i + 1 < content.size() && (content[i + 1] == ' ' || content[i + 1] == '#'))
+            {
+                current += content[++i];
+            }
+            else if (c == '\\' && i + 1 < content.size() && (content[i + 1] == '\n' || content[i + 1] == '\r'))
+            {
+                if (current != "") lines.back().push_back(current);
+                current.clear();
+                if (content[++i] == '\r' && i + 1 < content.size() && content[i + 1] == '\n') i++;
+            }
+            else if (c == '$' && i + 1 < content.size() && content[i + 1] == '$')
+            {
+                current += content[++i];
+            }
+            else if (c == ' ' || c == '\t' || c == '\n' || c == '\r')
+            {
+                if (current != "") lines.back().push_back(current);
+                current.clear();
+                if (c == '\n') lines.emplace_back();
+            }
+            else
+            {
+                current += c;
+            }
+        }
+        if (current != "") lines.back().push_back(current);
+
+        // each line is targets (the last one ends in a colon, which drive letters never do) and then the
+        // dependencies. GCC's module rules add variables, order-only dependencies after "|" and the
+        // name.c++m targets that stand for modules, none of which are files
+        auto moduleName = [](std::string word)
+            {
+                if (word.back() == ':') word.pop_back();
+                return word == ".PHONY" || (word.size() > 5 && word.compare(word.size() - 5, 5, ".c++m") == 0);
+            };
+        std::vector<std::filesystem::path> ret;
+        for (std::vector<std::string>& words : lines)
+        {
+            size_t i = 0;
+            while (i < words.size() && words[i] != ":" && words[i].back() != ':' && words[i].find(":|") == std::string::npos) i++;
+            if (i == words.size() || words[i].find(":|") != std::string::npos || moduleName(words[i])) continue;
+            for (i++; i < words.size() && words[i] != "|"; i++)
+            {
+                if (!moduleName(words[i])) ret.push_back({ words[i] });
+            }
+        }
+        return ret;
+    }
+
+
+// ------------------------ UI HELPER FUNCTIONS -------------------------
+
+    bool OpenFileDialog(std::filesystem::path& out, std::filesystem::path startingFolder, bool isFolder)
+    {
+      #if NOBPP_FILE_DIALOG_MODE == 2 && defined(_WIN32)
+        #define BREAK_ON_FAIL(x) if (FAILED(x)) break
+
+        bool ret = false;
+
+        IFileOpenDialog *fileDialog = nullptr;
+        do
+        {
+            BREAK_ON_FAIL(CoCreateInstance(CLSID_FileOpenDialog, NULL, CLSCTX_ALL, IID_IFileOpenDialog, (void**)(&fileDialog)));
+
+            if (isFolder)
+            {
+                FILEOPENDIALOGOPTIONS options = 0;
+                BREAK_ON_FAIL(fileDialog->GetOptions(&options));
+                options |= FOS_PICKFOLDERS;
+                BREAK_ON_FAIL(fileDialog->SetOptions(options));
+            }
+
+            HRESULT hr = fileDialog->Show(NULL);
+            if (hr == HRESULT_FROM_WIN32(ERROR_CANCELLED) || FAILED(hr))
+                break;
+
+            IShellItemArray *items;
+            BREAK_ON_FAIL(fileDialog->GetResults(&items));
+            DWORD itemCount = 0;
+            BREAK_ON_FAIL(items->GetCount(&itemCount));
+
+            if (itemCount != 1)
+            {
+                Log("Wrong number of items.", LogType::Error);
+                break;
+            }
+
+            IShellItem *item;
+            if (SUCCEEDED(items->GetItemAt(0, &item)))
+            {
+                PWSTR path;
+                if (SUCCEEDED(item->GetDisplayName(SIGDN_FILESYSPATH, &path)))
+                {
+                    out = path;
+                    ret = true;
+                    CoTaskMemFree(path);
+                }
+                item->Release();
+            }
+
+            items->Release();
+
+        } while (false);
+
+        if (fileDialog)
+            fileDialog->Release();
+
+        return ret;
+
+        #undef BREAK_ON_FAIL
+      #else
+        // basic file dialog mode
+        FlushLog();
+        while (true)
+        {
+            std::cout << "Enter " << (isFolder ? "directory" : "file") << " path: ";
+            std::string temp; std::getline(std::cin, temp);
+            if (temp == "") return false;
+
+            if (isFolder ? std::filesystem::is_directory({ temp }) : std::filesystem::is_regular_file({ temp }))
+            {
+                out = { temp };
+                return true;
+            }
+            else
+            {
+                std::cout << "Path not valid. Try again.\n";
+            }
+        }
+      #endif
+    }
+
+// ------------------------ COMPILE COMMANDS -------------------------
+
+    CompileCommand::CompileCommand(std::filesystem::path path)
+        : Command({
+#if defined(NOBPP_COMPILER_COMMAND)
+            NOBPP_COMPILER_COMMAND,
+#elif defined(__nob_msvc__)
+            "cl -c -EHsc -nologo",
+#elif defined(__nob_gcc__)
+            "g++ -c",
+#elif defined(__nob_clang__)
+            "clang++ -c",
+#else
+            ([]() {Log("Error: CompileCommand used with unknown compiler. Please define the NOBPP_COMPILER macro with the location of the compiler.\n", LogType::Info);return "";})(),
+#endif
+            path })
+    {
+        kind = CommandKind::Compile;
+    }
+
+    CompileCommand::CompileCommand(Command cmd)
+        : Command(std::move(cmd))
+    {
+        kind = CommandKind::Compile;
+    }
+
+    LinkCommand::LinkCommand(std::filesystem::path path)
+        : Command({
+#if defined(NOBPP_LINKER_COMMAND)
+            NOBPP_LINKER_COMMAND,
+#elif defined(__nob_msvc__)
+            "cl -nologo -link",
+#elif defined(__nob_gcc__)
+            "g++",
+#elif defined(__nob_clang__)
+            "clang++",
+#else
+            ([]() {Log("Error: LinkCommand used with unknown linker. Please define the NOBPP_LINKER macro with the location of the linker.\n", LogType::Info);return "";})(),
+#endif
+            path })
+    {
+        kind = CommandKind::Link;
+#if !defined(NOBPP_LINKER_COMMAND)
+        if (std::string(NOBPP_LINKER_NAME) != "")
+        {
+            *this = std::move(*this) + UseLinker{ NOBPP_LINKER_NAME };
+        }
+#endif
+    }
+
+    LinkCommand::LinkCommand(Command cmd)
+        : Command(std::move(cmd))
+    {
+        kind = CommandKind::Link;
+    }
+
+    nob::LibraryCommand::LibraryCommand(std::filesystem::path path)
+        : Command({
+#if defined(NOBPP_LIBRARY_COMMAND)
+            NOBPP_LIBRARY_COMMAND,
+#elif defined(__nob_msvc__)
+            "lib",
+#elif defined(__nob_gcc__)
+            "ar -rcs",
+#elif defined(__nob_clang__)
+            "ar -rcs",
+#else
+            ([]() {Log("Error: LibraryCommand used with unknown library archiver. Please define the NOBPP_LIBRARY macro with the location of the library archiver.\n", LogType::Info);return "";})(),
+#endif
+            path })
+    {
+        kind = CommandKind::Library;
+    }
+
+    nob::LibraryCommand::LibraryCommand(Command cmd)
+        : Command(std::move(cmd))
+    {
+        kind = CommandKind::Library;
+    }
+
+
+    namespace
+    {
+        // GCC and Clang compile a small header next to the pch that includes the real one. GCC finds
+        // X.gch when X is -include'd, and still has X to fall back on if the .gch does not match the command.
+        std::filesystem::path PrecompiledHeaderInclude(const std::filesystem::path& header, const std::filesystem::path& pch)
+        {
+            std::filesystem::path wrapper = std::filesystem::path(pch).replace_extension("");
+            std::error_code ec;
+            return std::filesystem::equivalent(wrapper, header, ec) ? header : wrapper;
+        }
+    }
+
+    CompileCommand PrecompiledHeaderCommand(CompileCommand cmd, std::filesystem::path header, std::filesystem::path pch)
+    {
+#if defined(__nob_msvc__)
+        cmd.UpdateInputTime(header);
+        cmd.UpdateOutputTime(pch);
+
+        return cmd + IncludeDirectory{ header.parent_path() } + std::string("-Yc") - header.filename() + std::string("-Fp") - pch;
+#elif defined(__nob_gcc__) || defined(__nob_clang__)
+        std::filesystem::path wrapper = PrecompiledHeaderInclude(header, pch);
+        if (wrapper != header)
+        {
+            std::error_code ec;
+            std::filesystem::create_directories(wrapper.parent_path(), ec);
+
+            // only written when it changes, so the pch is not rebuilt for nothing
+            std::string content = "#include \"" + std::filesystem::absolute(header).generic_string() + "\"\n";
+            std::ifstream in(wrapper, std::ios::binary);
+            std::string previous((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+            in.close();
+            if (previous != content)
+            {
+                std::ofstream(wrapper, std::ios::binary) << content;
+                InvalidateFileTime(wrapper);
+            }
+        }
+
+        // the dependency file makes edits to anything the header includes rebuild the pch
+        return cmd + IncludeDirectory{ header.parent_path() } + std::string("-x c++-header") + SourceFile{ wrapper } + ObjectFile{ pch };
+#else
+        cmd.UpdateInputTime(header);
+        cmd.UpdateOutputTime(pch);
+        return cmd;
+#endif
+    }
+
+    PrecompiledHeader CreatePrecompiledHeader(CompileCommand cmd, std::filesystem::path header, std::filesystem::path pch)
+    {
+        PrecompiledHeaderCommand(cmd, header, pch).Run();
+        return PrecompiledHeader(header, pch);
+    }
+
+    PrecompiledHeader UsePrecompiledHeader(std::filesystem::path header, std::filesystem::path pch)
+    {
+        return PrecompiledHeader(header, pch);
+    }
+
+
+    PrecompiledHeader::PrecompiledHeader(std::filesystem::path headerp, std::filesystem::path pchp)
+        : header(headerp), pch(pchp)
+    {
+    }
+
+
+
+    CompileCommand operator+(CompileCommand a, SourceFile b)
+    {
+        a.UpdateInputTime(b.path);
+        a.sourceFile = b.path;
+
+#if defined(__nob_msvc__)
+        return std::move(a) + b.path;
+#elif defined(__nob_gcc__)
+        return std::move(a) + b.path;
+#elif defined(__nob_clang__)
+        return std::move(a) + b.path;
+#else
+        return std::move(a) + b.path;
+#endif
+    }
+
+    CompileCommand AddOutputFile(CompileCommand a, ObjectFile b)
+    {
+#if defined(__nob_msvc__)
+        return std::move(a) + std::string("-Fo") - b.path;
+#elif defined(__nob_gcc__)
+        return std::move(a) + std::string("-o") + b.path;
+#elif defined(__nob_clang__)
+        return std::move(a) + std::string("-o") + b.path;
+#else
+        return std::move(a) + std::string("-o") + b.path;
+#endif
+    }
+
+    CompileCommand operator+(CompileCommand a, ObjectFile b)
+    {
+        a.UpdateOutputTime(b.path);
+        a.dependencyFile = std::filesystem::path(b.path).replace_extension(".d");
+
+#if defined(__nob_msvc__)
+        return AddOutputFile(a, b) + std::string("-showIncludes");
+#elif defined(__nob_gcc__)
+        return AddOutputFile(a, b) + std::string("-MMD -MF") + a.dependencyFile;
+#elif defined(__nob_clang__)
+        return AddOutputFile(a, b) + std::string("-MMD -MF") + a.dependencyFile;
+#else
+        a.dependencyFile.clear();  // unknown compilers may not support any dependency output
+        return AddOutputFile(a, b);
+#endif
+    }
+
+    CompileCommand operator+(CompileCommand a, IncludeDirectory b)
+    {
+#if defined(__nob_msvc__)
+        return std::move(a) + std::string("-I") - b.path;
+#elif defined(__nob_gcc__)
+        return std::move(a) + std::string("-I") - b.path;
+#elif defined(__nob_clang__)
+        return std::move(a) + std::string("-I") - b.path;
+#else
+        return std::move(a) + std::string("-I") - b.path;
+#endif
+    }
+
+    CompileCommand operator+(CompileCommand a, MacroDefinition b)
+    {
+#if defined(__nob_msvc__)
+        return std::move(a) + ("-D\"" + b.macro + "=" + b.definition + "\"");
+#elif defined(__nob_gcc__)
+        return std::move(a) + ("-D\"" + b.macro + "=" + b.definition + "\"");
+#elif defined(__nob_clang__)
+        return std::move(a) + ("-D\"" + b.macro + "=" + b.definition + "\"");
+#else
+        return std::move(a) + ("-D\"" + b.macro + "=" + b.definition + "\"");
+#endif
+    }
+
+    CompileCommand operator+(CompileCommand a, PrecompiledHeader b)
+    {
+        a.UpdateInputTime(b.header);
+        a.UpdateInputTime(b.pch);
+
+#if defined(__nob_msvc__)
+        return std::move(a) + IncludeDirectory{ b.header.parent_path() } + std::string("-Yu") - b.header.filename()  + std::string("-Fp") - b.pch;
+#elif defined(__nob_gcc__)
+        return std::move(a) + IncludeDirectory{ b.header.parent_path() } + std::string("-Winvalid-pch -include") + PrecompiledHeaderInclude(b.header, b.pch);
+#elif defined(__nob_clang__)
+        return std::move(a) + IncludeDirectory{ b.header.parent_path() } + std::string("-include-pch") + b.pch;
+#else
+        return a;
+#endif
+    }
+
+    CompileCommand operator+(CompileCommand a, CompilerFlag b)
+    {
+#if defined(NOBPP_CUSTOM_COMPILER_FLAG_HANDLER)
+        return std::move(a) + NOBPP_CUSTOM_COMPILER_FLAG_HANDLER(b);
+#else
+        switch (b)
+        {
+#if defined(__nob_msvc__)
+        case CompilerFlag::OptimizeSpeed: return std::move(a) + std::string("-O2"); break;
+        case CompilerFlag::OptimizeSpace: return std::move(a) + std::string("-O1"); break;
+        case CompilerFlag::Debug: return std::move(a) + std::string("-Zi"); break;
+        case CompilerFlag::DebugSplit: return std::move(a) + std::string("-Z7"); break;
+        case CompilerFlag::DebugCompressed: return std::move(a) + std::string("-Z7"); break;
+        case CompilerFlag::CPPVersion14: return std::move(a) + std::string("-std:c++14"); break;
+        case CompilerFlag::CPPVersion17: return std::move(a) + std::string("-std:c++17"); break;
+        case CompilerFlag::CPPVersion20: return std::move(a) + std::string(ProbedSupports(a, "-std:c++20") ? "-std:c++20" : "-std:c++latest"); break;
+        case CompilerFlag::TimeTrace: return std::move(a) + std::string("-Bt+ -d1reportTime"); break;
+        case CompilerFlag::LTO: return std::move(a) + std::string("-GL"); break;
+        case CompilerFlag::ThinLTO: return std::move(a) + std::string("-GL"); break;
+#elif defined(__nob_gcc__)
+        case CompilerFlag::OptimizeSpeed: return std::move(a) + std::string("-O2"); break;
+        case CompilerFlag::OptimizeSpace: return std::move(a) + std::string("-Os"); break;
+        case CompilerFlag::Debug: return std::move(a) + std::string("-g"); break;
+        case CompilerFlag::DebugSplit: return std::move(a) + std::string("-g -gsplit-dwarf"); break;
+        case CompilerFlag::DebugCompressed: return std::move(a) + std::string("-g -gz"); break;
+        case CompilerFlag::CPPVersion14: return std::move(a) + std::string("-std=c++14"); break;
+        case CompilerFlag::CPPVersion17: return std::move(a) + std::string("-std=c++17"); break;
+        case CompilerFlag::CPPVersion20: return std::move(a) + std::string(ProbedSupports(a, "-std=c++20") ? "-std=c++20" : "-std=c++2a"); break;
+        case CompilerFlag::TimeTrace: return a; break;  // GCC has no per-header timing, so the report only has the slowest sources
+        case CompilerFlag::LTO: return std::move(a) + std::string("-flto"); break;
+        case CompilerFlag::ThinLTO: return std::move(a) + std::string("-flto"); break;
+#elif defined(__nob_clang__)
+        case CompilerFlag::OptimizeSpeed: return std::move(a) + std::string("-O2"); break;
+        case CompilerFlag::OptimizeSpace: return std::move(a) + std::string("-Os"); break;
+        case CompilerFlag::Debug: return std::move(a) + std::string("-g"); break;
+        case CompilerFlag::DebugSplit: return std::move(a) + std::string("-g -gsplit-dwarf"); break;
+        case CompilerFlag::DebugCompressed: return std::move(a) + std::string("-g -gz"); break;
+        case CompilerFlag::CPPVersion14: return std::move(a) + std::string("-std=c++14"); break;
+        case CompilerFlag::CPPVersion17: return std::move(a) + std::string("-std=c++17"); break;
+        case CompilerFlag::CPPVersion20: return std::move(a) + std::string(ProbedSupports(a, "-std=c++20") ? "-std=c++20" : "-std=c++2a"); break;
+        case CompilerFlag::TimeTrace:
+        {
+            if (ProbedSupports(a, "-ftime-trace")) return std::move(a) + std::string("-ftime-trace");
+            Log("This clang has no -ftime-trace (it needs clang 9), so the report only has the slowest sources.\n", LogType::Info);
+            return a;
+        }
+        case CompilerFlag::LTO: return std::move(a) + std::string("-flto"); break;
+        case CompilerFlag::ThinLTO: return std::move(a) + std::string("-flto=thin"); break;
+#endif
+
+#if defined(_WIN32)
+        case CompilerFlag::PositionIndependentCode: return a; break;
+#else
+        case CompilerFlag::PositionIndependentCode: return std::move(a) + CustomCompilerFlag{ "-fPIC" }; break;
+#endif
+
+
+        case CompilerFlag::KeepLinker:
+        {
+            size_t loc = a.text.find(" -c");
+            if (loc == std::string::npos)
+            {
+                return a;
+            }
+            else
+            {
+                a.text = a.text.substr(0, loc) + a.text.substr(loc + 3);
+                return a;
+            }
+        }
+        case CompilerFlag::NoObjectFile:
+        {
+            size_t loc = a.text.find(" ");
+
+            // perform surgery so that this command is always overriden if + ObjectFile is used
+            std::string tmp = a.text.substr(loc);
+            a.text = a.text.substr(0, loc);
+            a = AddOutputFile(a, ObjectFile{ std::filesystem::temp_directory_path() / "nobDeletedObj.o" });
+            a.text += tmp;
+            return a;
+        }
+        default:
+            Log("CompilerFlag is not supported by your compiler.\n", LogType::Info); return a;
+            break;
+        }
+#endif
+    }
+
+    CompileCommand operator+(CompileCommand a, CustomCompilerFlag b)
+    {
+        return (Command)std::move(a) + b.flag;
+    }
+
+    LinkCommand AddDefaultOutputToLinker(CompileCommand a, LinkCommand b)
+    {
+        if (b.text.find(" -o") != std::string::npos)
+        {
+            return b;
+        }
+        else
+        {
+            for (int i = 0; i < a.text.size() - 1; i++)
+            {
+                if (a.text[i] == ' ' and a.text[i + 1] != ' ' and a.text[i + 1] != '-')
+                {  // an argument with no - prefix is a source file
+                    std::filesystem::path file;
+
+                    if (a.text[i + 1] == '"')
+                    {
+                        file = a.text.substr(i + 2, a.text.substr(i + 2).find('"'));
+                    }
+                    else
+                    {
+                        file = a.text.substr(i + 1, a.text.substr(i + 1).find(' '));
+                    }
+#ifdef _WIN32
+                    file = file.replace_extension("exe");
+#else
+                    file = file.replace_extension("");
+#endif
+                    return b + ExecutableFile{ file };
+                }
+            }
+
+            return b;
+        }
+    }
+
+    CompileCommand operator+(CompileCommand a, AddLinkCommand b)
+    {
+#if defined(__nob_msvc__)
+        // cl only links with link.exe, so one that was switched to lld-link gets -link back
+        std::string linker = AddDefaultOutputToLinker(a, b.lc).text;
+        size_t pos = linker.find("-link");
+        return a + CompilerFlag::KeepLinker + CompilerFlag::NoObjectFile + (pos != std::string::npos ? linker.substr(pos) : "-link" + linker.substr(linker.find(' ')));
+#elif defined(__nob_gcc__)
+        return a + CompilerFlag::KeepLinker + CompilerFlag::NoObjectFile + AddDefaultOutputToLinker(a, b.lc).text.substr(b.lc.text.find(" "));
+#elif defined(__nob_clang__)
+        return a + CompilerFlag::KeepLinker + CompilerFlag::NoObjectFile + AddDefaultOutputToLinker(a, b.lc).text.substr(b.lc.text.find(" "));
+#else
+        return a + CompilerFlag::KeepLinker + CompilerFlag::NoObjectFile + AddDefaultOutputToLinker(a, b.lc).text.substr(b.lc.text.find(" "));
+#endif
+    }
+
+    namespace
+    {
+        // where GCC and Clang write the raw profiles of an instrumented program (GCC also reads them from there)
+        std::filesystem::path RawProfileDirectory(const std::filesystem::path& profile)
+        {
+            return std::filesystem::absolute(profile).parent_path() / (profile.filename().string() + ".raw");
+        }
+    }
+
+    CompileCommand operator+(CompileCommand a, ProfileGenerate b)
+    {
+#if defined(__nob_msvc__)
+        return std::move(a) + std::string("-GL");  // the instrumenting is done by the link
+#else
+        return (Command)std::move(a) + std::string("-fprofile-generate=") - RawProfileDirectory(b.profile);
+#endif
+    }
+
+    CompileCommand operator+(CompileCommand a, ProfileUse b)
+    {
+        a.UpdateInputTime(b.profile, true);
+#if defined(__nob_msvc__)
+        return std::move(a) + std::string("-GL");
+#elif defined(__nob_gcc__)
+        // sources the training never reached have no .gcda, which GCC would warn about for each of them
+        return (Command)std::move(a) + std::string("-fprofile-use=") - RawProfileDirectory(b.profile) + std::string("-Wno-missing-profile");
+#else
+        return (Command)std::move(a) + std::string("-fprofile-use=") - b.profile;
+#endif
+    }
+
+    LinkCommand operator+(LinkCommand a, ObjectFile b)
+    {
+        a.UpdateInputTime(b.path);
+
+#if defined(__nob_msvc__)
+        // objects go before -link, and only the (short) linker options after it are moved
+        size_t pos = a.text.find("-link");
+        if (pos == std::string::npos) return std::move(a) + b.path;
+        a.text.insert(pos, "\"" + b.path.string() + "\" ");
+        return a;
+#elif defined(__nob_gcc__)
+        return std::move(a) + b.path;
+#elif defined(__nob_clang__)
+        return std::move(a) + b.path;
+#else
+        return std::move(a) + b.path;
+#endif
+    }
+
+    LinkCommand operator+(LinkCommand a, StaticLibraryFile b)
+    {
+        a.UpdateInputTime(b.path, true);
+
+        if (b.path.extension().string() == "a" or b.path.extension().string() == "lib")
+        {
+#if defined(_WIN32)
+            b.path.replace_extension("lib");
+#else
+            b.path.replace_extension("a");
+#endif
+        }
+
+#if defined(__nob_msvc__)
+        return std::move(a) + b.path;
+#elif defined(__nob_gcc__)
+        return std::move(a) + b.path;
+#elif defined(__nob_clang__)
+        return std::move(a) + b.path;
+#else
+        return std::move(a) + b.path;
+#endif
+    }
+
+    LinkCommand operator+(LinkCommand a, DynamicLibraryFile b)
+    {
+#if defined(_WIN32)
+        b.path.replace_extension("dll");
+#elif defined(__APPLE__)
+        b.path.replace_extension("dylib");
+#else
+        b.path.replace_extension("so");
+#endif
+        return std::move(a) + StaticLibraryFile{ b.path };
+    }
+
+    LinkCommand operator+(LinkCommand a, ExecutableFile b)
+    {
+        a.UpdateOutputTime(b.path);
+
+#if defined(__nob_msvc__)
+        return std::move(a) + std::string("-out:") - b.path;
+#elif defined(__nob_gcc__)
+        return std::move(a) + std::string("-o") + b.path;
+#elif defined(__nob_clang__)
+        return std::move(a) + std::string("-o") + b.path;
+#else
+        return std::move(a) + std::string("-o") + b.path;
+#endif
+    }
+
+    LinkCommand operator+(LinkCommand a, LinkerFlag b)
+    {
+#if defined(NOBPP_CUSTOM_LINKER_FLAG_HANDLER)
+        return std::move(a) + NOBPP_CUSTOM_LINKER_FLAG_HANDLER(b);
+#else
+        switch (b)
+        {
+#if defined(__nob_msvc__)
+        case LinkerFlag::OutputDynamicLibrary: return std::move(a) + std::string("-dll"); break;
+        case LinkerFlag::Debug: return std::move(a) + std::string("-debug"); break;
+        case LinkerFlag::DebugSplit: return std::move(a) + std::string("-debug:fastlink"); break;  // the PDB points into the objects instead of copying them
+        case LinkerFlag::DebugCompressed: return std::move(a) + std::string("-debug"); break;
+        case LinkerFlag::LTO: return std::move(a) + std::string("-LTCG"); break;
+        case LinkerFlag::ThinLTO: return std::move(a) + std::string("-LTCG:INCREMENTAL"); break;
+        case LinkerFlag::Incremental: return std::move(a) + std::string("-INCREMENTAL"); break;
+#elif defined(__nob_gcc__)
+        case LinkerFlag::OutputDynamicLibrary: return std::move(a) + std::string("-shared"); break;
+        case LinkerFlag::Debug: return std::move(a) + std::string("-g"); break;
+        case LinkerFlag::DebugSplit: return std::move(a) + std::string("-g -gsplit-dwarf"); break;  // for the code LTO generates at link time
+        case LinkerFlag::DebugCompressed: return std::move(a) + std::string("-g -gz"); break;  // the linker compresses the output's sections too
+        case LinkerFlag::LTO: return std::move(a) + std::string(ProbedSupports(a, "-flto=auto") ? "-flto=auto" : "-flto"); break;  // as many partitions in parallel as there are cores, from GCC 10
+        case LinkerFlag::ThinLTO: return std::move(a) + std::string(ProbedSupports(a, "-flto=auto") ? "-flto=auto" : "-flto"); break;
+#elif defined(__nob_clang__)
+        case LinkerFlag::OutputDynamicLibrary: return std::move(a) + std::string("-shared"); break;
+        case LinkerFlag::Debug: return std::move(a) + std::string("-g"); break;
+        case LinkerFlag::DebugSplit: return std::move(a) + std::string("-g -gsplit-dwarf"); break;  // for the code LTO generates at link time
+        case LinkerFlag::DebugCompressed: return std::move(a) + std::string("-g -gz"); break;  // the linker compresses the output's sections too
+        case LinkerFlag::LTO: return std::move(a) + std::string("-flto"); break;
+        case LinkerFlag::ThinLTO: return std::move(a) + std::string("-flto=thin"); break;
+#endif
+        default:
+            Log("LinkerFlag is not supported by your compiler.\n", LogType::Info); return a;
+            break;
+        }
+#endif
+    }
+
+    LinkCommand operator+(LinkCommand a, CustomLinkerFlag b)
+    {
+        return (Command)std::move(a) + b.flag;
+    }
+
+    bool LinkerAvailable(std::string name)
+    {
+        static std::mutex mutex;
+        static std::unordered_map<std::string, bool> found;
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = found.find(name);
+        if (it != found.end()) return it->second;
+
+        // the program the compiler driver looks for when given -fuse-ld=name
+#if defined(__nob_msvc__)
+        std::vector<std::string> programs = { name + "-link.exe" };
+#elif defined(_WIN32)
+        std::vector<std::string> programs = { "ld." + name + ".exe", name + "-link.exe" };
+#elif defined(__APPLE__)
+        std::vector<std::string> programs = { "ld64." + name, "ld." + name };
+#else
+        std::vector<std::string> programs = { "ld." + name };
+#endif
+        bool ret = !FindOnPath(programs).empty();
+
+        if (!ret) Log("The " + name + " linker was not found on PATH, so the default linker is used.\n", LogType::Info);
+        found[name] = ret;
+        return ret;
+    }
+
+    LinkCommand operator+(LinkCommand a, UseLinker b)
+    {
+        if (b.name == "" || !LinkerAvailable(b.name)) return a;
+#if defined(__nob_msvc__)
+        // cl cannot be told which linker to run, so lld-link is run instead of it, with what cl passes on to link.exe
+        size_t pos = a.text.find(" -link");
+        if (pos != std::string::npos) a.text.erase(pos, std::strlen(" -link"));
+        size_t program = a.text.find(' ');
+        a.text = b.name + "-link" + (program == std::string::npos ? "" : a.text.substr(program));
+        return a;
+#else
+        return std::move(a) + ("-fuse-ld=" + b.name);
+#endif
+    }
+
+    LinkCommand operator+(LinkCommand a, LTOCache b)
+    {
+        std::error_code ec;
+        std::filesystem::create_directories(b.directory, ec);
+#if defined(__nob_clang__) && defined(__APPLE__)
+        return std::move(a) + ("\"-Wl,-cache_path_lto," + b.directory.string() + "\"");
+#elif defined(__nob_clang__) && defined(_WIN32)
+        return std::move(a) + ("\"-Wl,/lldltocache:" + b.directory.string() + "\"");
+#elif defined(__nob_clang__)
+        return std::move(a) + ("\"-Wl,--thinlto-cache-dir=" + b.directory.string() + "\"");
+#else
+        return a;  // GCC partitions the whole program every time, and MSVC keeps its incremental state next to the output
+#endif
+    }
+
+    LinkCommand operator+(LinkCommand a, ProfileGenerate b)
+    {
+#if defined(__nob_msvc__)
+        return (Command)std::move(a) + std::string("-LTCG -GENPROFILE:PGD=") - b.profile;
+#else
+        return (Command)std::move(a) + std::string("-fprofile-generate=") - RawProfileDirectory(b.profile);  // for the profiling runtime
+#endif
+    }
+
+    LinkCommand operator+(LinkCommand a, ProfileUse b)
+    {
+        a.UpdateInputTime(b.profile, true);
+#if defined(__nob_msvc__)
+        return (Command)std::move(a) + std::string("-LTCG -USEPROFILE:PGD=") - b.profile;
+#elif defined(__nob_gcc__)
+        return (Command)std::move(a) + std::string("-fprofile-use=") - RawProfileDirectory(b.profile) + std::string("-Wno-missing-profile");  // LTO optimizes again at link time
+#else
+        return a;  // Clang applies the profile when compiling, even with LTO
+#endif
+    }
+
+
+    LibraryCommand operator+(LibraryCommand a, ObjectFile b)
+    {
+        a.UpdateInputTime(b.path);
+
+        return std::move(a) + b.path;
+    }
+
+    LibraryCommand operator+(LibraryCommand a, StaticLibraryFile b)
+    {
+        a.UpdateOutputTime(b.path);
+
+#if defined(__nob_msvc__)
+        return std::move(a) + std::string("-out:") - b.path;
+#else
+        return std::move(a) + b.path;
+#endif
+    }
+
+
+
+    namespace
+    {
+        // The unity_<batch>.cpp and unity_<directory>_<hash>.cpp files GroupUnityFiles writes, and their objects.
+        // A source's own object keeps the source's extension (obj/unity_x.cpp.obj), so it never matches.
+        bool IsUnityFile(const std::filesystem::path& file)
+        {
+            std::string stem = file.stem().string();
+            if (stem.rfind("unity_", 0) != 0 || stem.size() == 6) return false;
+            std::string name = stem.substr(6);
+            auto all = [](const std::string& text, int (*is)(int)) { return std::all_of(text.begin(), text.end(), [&](char c) { return is((unsigned char)c) != 0; }); };
+            if (all(name, std::isdigit)) return true;
+
+            auto hashed = [&](size_t end) { return end >= 9 && name[end - 9] == '_' && all(name.substr(end - 8, 8), std::isxdigit); };
+            size_t last = name.rfind('_');
+            bool duplicate = last != std::string::npos && last + 1 < name.size() && all(name.substr(last + 1), std::isdigit) && hashed(last);
+            return std::all_of(name.begin(), name.end(), [](char c) { return std::isalnum((unsigned char)c) || c == '_'; })
+                && (hashed(name.size()) || duplicate);
+        }
+
+        // obj/<path of source under src>.obj, so src/a/util.cpp and src/b/util.cpp (or foo.cpp and foo.cppm) do not share one
+        std::filesystem::path DirectoryObjectFile(const std::filesystem::path& src, const std::filesystem::path& obj, const std::filesystem::path& source)
+        {
+            std::filesystem::path relative = source.lexically_relative(src);
+            if (relative.empty() || *relative.begin() == "..") relative = source.filename();
+            return obj / (relative.string() + ".obj");
+        }
+
+        std::string ManifestPath(const std::filesystem::path& file, const std::filesystem::path& obj)  // relative to obj, so the tree can move
+        {
+            std::error_code ec;
+            return std::filesystem::absolute(file, ec).lexically_normal().lexically_relative(std::filesystem::absolute(obj, ec).lexically_normal()).generic_string();
+        }
+
+        // obj/objects.list has a line per object CompileDirectory made, as its source directory and the object,
+        // separated by a tab. found is false when there is no list.
+        std::vector<std::pair<std::string, std::string>> ReadObjectManifest(const std::filesystem::path& obj, bool& found)
+        {
+            std::vector<std::pair<std::string, std::string>> ret;
+            std::ifstream in(obj / "objects.list", std::ios::binary);
+            found = in.is_open();
+            std::string line;
+            while (std::getline(in, line))
+            {
+                size_t tab = line.find('\t');
+                if (tab != std::string::npos) ret.push_back({ line.substr(0, tab), line.substr(tab + 1) });
+            }
+            return ret;
+        }
 
-    std::string RemoveEscapes(std::string inp)
-    {
-        std::string ret = "";
-        for (int i = 0; i < inp.size(); i++)
+        // Replaces src's objects in the list, and removes the objects of sources that are gone (or went into
+        // a unity file), which LinkDirectory would otherwise link with the rest.
+        void WriteObjectManifest(const std::filesystem::path& src, const std::filesystem::path& obj, const std::vector<CompileCommand>& jobs)
         {
-            if (inp[i] == '\\')
+            bool found = false;
+            std::vector<std::pair<std::string, std::string>> lines = ReadObjectManifest(obj, found);
+            std::string directory = ManifestPath(src, obj);
+            std::unordered_set<std::string> current;
+            for (const CompileCommand& job : jobs)
             {
-                i++;
-                switch (inp[i])
+                current.insert(ManifestPath(job.outputs[0].path, obj));
+            }
+
+            std::string previous;
+            std::string content;
+            for (auto& [source, object] : lines)
+            {
+                previous += source + "\t" + object + "\n";
+                if (source != directory)
                 {
-                case '\'': ret += "\'"; break;
-                case '\"': ret += "\""; break;
-                case '\?': ret += "\?"; break;
-                case '\\': ret += "\\"; break;
-                case '\a': ret += "a"; break;
-                case '\b': ret += "b"; break;
-                case '\f': ret += "f"; break;
-                case '\n': ret += "n"; break;
-                case '\r': ret += "r"; break;
-                case '\t': ret += "t"; break;
-                case '\v': ret += "v"; break;
-                default: Log("Error: unrecognized escape code cannot be removed."); break;
+                    content += source + "\t" + object + "\n";
+                }
+                else if (!current.count(object))
+                {
+                    std::error_code ec;
+                    std::filesystem::remove(obj / object, ec);
+                    std::filesystem::remove((obj / object).replace_extension(".d"), ec);
+                    InvalidateFileTime(obj / object);
                 }
             }
-            else
+            for (const CompileCommand& job : jobs)
             {
-                ret += inp[i];
+                content += directory + "\t" + ManifestPath(job.outputs[0].path, obj) + "\n";
+            }
+            if (content != previous || !found)
+            {
+                std::ofstream(obj / "objects.list", std::ios::binary) << content;
             }
         }
-        return ret;
-    }
-
-
-// ------------------------ UI HELPER FUNCTIONS -------------------------
-
-    bool OpenFileDialog(std::filesystem::path& out, std::filesystem::path startingFolder, bool isFolder)
-    {
-      #if NOBPP_FILE_DIALOG_MODE == 2 && defined(_WIN32)
-        #define BREAK_ON_FAIL(x) if (FAILED(x)) break
 
-        bool ret = false;
-
-        IFileOpenDialog *fileDialog = nullptr;
-        do
+        // Writes the generated unity files (only the ones whose contents changed), and removes
+        // any objects left over from an earlier grouping so LinkDirectory does not link them twice.
+        std::vector<std::pair<std::filesystem::path, std::vector<std::filesystem::path>>> GroupUnityFiles(const std::vector<std::filesystem::path>& sources,
+            std::filesystem::path src, std::filesystem::path obj, const CompileDirectoryOptions& options, std::vector<std::filesystem::path>& singles)
         {
-            BREAK_ON_FAIL(CoCreateInstance(CLSID_FileOpenDialog, NULL, CLSCTX_ALL, IID_IFileOpenDialog, (void**)(&fileDialog)));
-
-            if (isFolder)
+            std::error_code ec;
+            std::filesystem::path isolatedList = obj / "unity_isolated.txt";
+            std::unordered_set<std::string> isolated;
+            if (!CLFlags[CLArgument::Clean])
             {
-                FILEOPENDIALOGOPTIONS options = 0;
-                BREAK_ON_FAIL(fileDialog->GetOptions(&options));
-                options |= FOS_PICKFOLDERS;
-                BREAK_ON_FAIL(fileDialog->SetOptions(options));
+                std::ifstream in(isolatedList);
+                std::string line;
+                while (std::getline(in, line))
+                {
+                    if (line != "") isolated.insert(std::filesystem::path(line).lexically_normal().generic_string());
+                }
             }
 
-            HRESULT hr = fileDialog->Show(NULL);
-            if (hr == HRESULT_FROM_WIN32(ERROR_CANCELLED) || FAILED(hr))
-                break;
+            if (options.unityIsolateChanged && std::filesystem::is_directory(obj, ec))
+            {
+                // a source newer than the batch object it went into was edited since the last build
+                for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(obj, ec))
+                {
+                    CacheFileTime(entry);  // the batch objects are in the same walk
+                    const std::filesystem::path& p = entry.path();
+                    if (!IsUnityFile(p) || p.extension() != ".cpp") continue;
 
-            IShellItemArray *items;
-            BREAK_ON_FAIL(fileDialog->GetResults(&items));
-            DWORD itemCount = 0;
-            BREAK_ON_FAIL(items->GetCount(&itemCount));
+                    int64_t built = GetWriteTime(std::filesystem::path(p).replace_extension(".obj"));
+                    if (built == INT64_MIN) continue;
 
-            if (itemCount != 1)
-            {
-                Log("Wrong number of items.", LogType::Error);
-                break;
+                    std::ifstream in(p);
+                    std::string line;
+                    while (std::getline(in, line))
+                    {
+                        if (line.rfind("#include \"", 0) != 0) continue;
+                        std::string file = line.substr(10, line.rfind('"') - 10);
+                        if (GetWriteTime(file) > built) isolated.insert(std::filesystem::path(file).lexically_normal().generic_string());
+                    }
+                }
             }
 
-            IShellItem *item;
-            if (SUCCEEDED(items->GetItemAt(0, &item)))
+            auto excluded = [&](const std::filesystem::path& p)
+                {
+                    for (const std::filesystem::path& e : options.unityExclude)
+                    {
+                        if (e == p.filename() || e.lexically_normal() == p.lexically_relative(src).lexically_normal() || e == p) return true;
+                    }
+                    return false;
+                };
+
+            std::vector<std::pair<std::filesystem::path, std::vector<std::filesystem::path>>> ret;
+            std::unordered_map<std::string, size_t> directories;
+            std::unordered_set<std::string> names;
+            size_t batchBytes = 0;
+            std::string saved;
+            for (const std::filesystem::path& p : sources)
             {
-                PWSTR path;
-                if (SUCCEEDED(item->GetDisplayName(SIGDN_FILESYSPATH, &path)))
+                std::string generic = p.lexically_normal().generic_string();  // as the #include lines have it
+                if (isolated.count(generic))
                 {
-                    out = path;
-                    ret = true;
-                    CoTaskMemFree(path);
+                    saved += generic + "\n";
+                    singles.push_back(p);
+                    continue;
+                }
+                if (excluded(p))
+                {
+                    singles.push_back(p);
+                    continue;
+                }
+
+                if (options.unityByDirectory)
+                {
+                    std::string directory = p.parent_path().lexically_relative(src).generic_string();
+                    auto [it, added] = directories.insert({ directory, ret.size() });
+                    if (added)
+                    {
+                        std::string name = "unity_" + (directory == "." ? std::string("root") : directory);
+                        for (char& c : name)
+                        {
+                            if (!std::isalnum((unsigned char)c)) c = '_';
+                        }
+                        // a/b, a_b and a.b all become unity_a_b, so the directory's hash tells them apart
+                        char hash[16];
+                        std::snprintf(hash, sizeof(hash), "_%08llx", (unsigned long long)(HashString(directory) & 0xffffffff));
+                        name += hash;
+                        while (!names.insert(name).second) name += "_" + std::to_string(ret.size());
+                        ret.push_back({ obj / (name + ".cpp"), {} });
+                    }
+                    ret[it->second].second.push_back(p);
+                }
+                else
+                {
+                    if (ret.empty() || batchBytes >= options.unityBatchBytes)
+                    {
+                        ret.push_back({ obj / ("unity_" + std::to_string(ret.size()) + ".cpp"), {} });
+                        batchBytes = 0;
+                    }
+                    ret.back().second.push_back(p);
+                    batchBytes += std::filesystem::file_size(p, ec);
                 }
-                item->Release();
             }
 
-            items->Release();
+            std::filesystem::create_directories(obj, ec);
+            std::unordered_set<std::string> current;
+            for (auto& [unityFile, files] : ret)
+            {
+                current.insert(unityFile.stem().string());
 
-        } while (false);
+                std::string content = "// generated by nobpp for a unity build, do not edit\n";
+                for (const std::filesystem::path& p : files)
+                {
+                    content += "#include \"" + p.generic_string() + "\"\n";
 
-        if (fileDialog)
-            fileDialog->Release();
+                    // the source used to be compiled on its own
+                    std::filesystem::path object = DirectoryObjectFile(src, obj, p);
+                    std::filesystem::remove(object, ec);
+                    std::filesystem::remove(std::filesystem::path(object).replace_extension(".d"), ec);
+                    InvalidateFileTime(object);
+                }
 
-        return ret;
+                std::ifstream in(unityFile, std::ios::binary);
+                std::string previous((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+                in.close();
+                if (previous != content)
+                {
+                    std::ofstream(unityFile, std::ios::binary) << content;
+                    InvalidateFileTime(unityFile);
+                }
+            }
 
-        #undef BREAK_ON_FAIL
-      #else
-        // basic file dialog mode
-        while (true)
-        {
-            std::cout << "Enter " << (isFolder ? "directory" : "file") << " path: ";
-            std::string temp; std::getline(std::cin, temp);
-            if (temp == "") return false;
+            for (const std::filesystem::path& p : std::filesystem::directory_iterator(obj, ec))
+            {
+                if (IsUnityFile(p) && p != isolatedList && !current.count(p.stem().string()))
+                {
+                    std::filesystem::remove(p, ec);
+                }
+            }
 
-            if (isFolder ? std::filesystem::is_directory({ temp }) : std::filesystem::is_regular_file({ temp }))
+            if (saved == "")
             {
-                out = { temp };
-                return true;
+                std::filesystem::remove(isolatedList, ec);
             }
             else
             {
-                std::cout << "Path not valid. Try again.\n";
+                std::ofstream(isolatedList) << saved;
             }
-        }
-      #endif
-    }
 
-// ------------------------ COMPILE COMMANDS -------------------------
+            return ret;
+        }
 
-    CompileCommand::CompileCommand(std::filesystem::path path)
-        : Command({
-#if defined(NOBPP_COMPILER_COMMAND)
-            NOBPP_COMPILER_COMMAND,
-#elif defined(__nob_msvc__)
-            "cl -c -EHsc -nologo",
-#elif defined(__nob_gcc__)
-            "g++ -c",
-#elif defined(__nob_clang__)
-            "clang++ -c",
+        std::filesystem::path DirectoryPrecompiledHeader(std::filesystem::path obj, std::filesystem::path header)
+        {
+#if defined(__nob_gcc__)
+            return obj / (header.filename().string() + ".gch");
 #else
-            ([]() {Log("Error: CompileCommand used with unknown compiler. Please define the NOBPP_COMPILER macro with the location of the compiler.\n", LogType::Info);return "";})(),
+            return obj / (header.filename().string() + ".pch");
 #endif
-            path })
-    {
+        }
 
-    }
+        bool IsModuleInterface(const std::filesystem::path& source)
+        {
+            return source.extension() == ".cppm" || source.extension() == ".ixx";
+        }
 
-    inline CompileCommand::CompileCommand(Command cmd)
-        : Command(cmd)
-    {
-    }
+        // what a source says about modules: the one it provides (interface or partition) and the ones it imports
+        struct ModuleScan
+        {
+            std::string provides;
+            bool exported = false;  // "export module", as opposed to an internal partition
+            std::vector<std::string> imports;
 
-    LinkCommand::LinkCommand(std::filesystem::path path)
-        : Command({
-#if defined(NOBPP_LINKER_COMMAND)
-            NOBPP_LINKER_COMMAND,
-#elif defined(__nob_msvc__)
-            "cl -nologo -link",
-#elif defined(__nob_gcc__)
-            "g++",
-#elif defined(__nob_clang__)
-            "clang++",
-#else
-            ([]() {Log("Error: LinkCommand used with unknown linker. Please define the NOBPP_LINKER macro with the location of the linker.\n", LogType::Info);return "";})(),
-#endif
-            path })
-    {
+            bool Uses() const { return provides != "" || !imports.empty(); }
+        };
 
-    }
+        // Reads the module declarations from the source itself, which GCC has no scanner for. Imports
+        // inside #if blocks count either way, which the compilers' P1689 scans get right.
+        ModuleScan ReadModuleDeclarations(const std::filesystem::path& source)
+        {
+            ModuleScan ret;
+            std::string primary;  // the module this unit belongs to, which ":partition" imports are part of
+            std::ifstream in(source, std::ios::binary);
+            std::string line;
+            bool comment = false;
+            while (std::getline(in, line))
+            {
+                std::string code;
+                for (size_t i = 0; i < line.size(); i++)
+                {
+                    if (comment)
+                    {
+                        if (line.compare(i, 2, "*/") == 0) { comment = false; i++; }
+                    }
+                    else if (line.compare(i, 2, "/*") == 0) { comment = true; i++; }
+                    else if (line.compare(i, 2, "//") == 0) break;
+                    else code += line[i];
+                }
+                size_t start = code.find_first_not_of(" \t\r");
+                if (start == std::string::npos) continue;
+                code.erase(0, start);
+                bool exported = code.compare(0, 7, "export ") == 0;
+                if (exported) code.erase(0, std::min(code.find_first_not_of(" \t", 7), code.size()));
+
+                // the name up to the semicolon, without the spaces "M : part" is allowed to have
+                auto name = [&](size_t from)
+                    {
+                        std::string ret;
+                        for (size_t i = from; i < code.size() && code[i] != ';'; i++)
+                        {
+                            if (!std::isspace((unsigned char)code[i])) ret += code[i];
+                        }
+                        return ret;
+                    };
+                auto keyword = [&](const std::string& word)
+                    {
+                        return code.compare(0, word.size(), word) == 0 && code.size() > word.size() && std::strchr(" \t;:<\"", code[word.size()]);
+                    };
 
-    inline LinkCommand::LinkCommand(Command cmd)
-        : Command(cmd)
-    {
-    }
+                if (keyword("module"))
+                {
+                    std::string module = name(6);
+                    if (module == "" || module == ":private") continue;  // the global module fragment and the private one
+                    primary = module.substr(0, module.find(':'));
+                    if (exported || module.find(':') != std::string::npos)
+                    {
+                        ret.provides = module;
+                        ret.exported = exported;
+                    }
+                    else
+                    {
+                        ret.imports.push_back(module);  // an implementation unit imports its interface
+                    }
+                }
+                else if (keyword("import"))
+                {
+                    std::string module = name(6);
+                    if (module == "" || module[0] == '<' || module[0] == '"') continue;  // header units are not built here
+                    ret.imports.push_back(module[0] == ':' ? primary + module : module);
+                }
+            }
+            return ret;
+        }
 
-    nob::LibraryCommand::LibraryCommand(std::filesystem::path path)
-        : Command({
-#if defined(NOBPP_LIBRARY_COMMAND)
-            NOBPP_LIBRARY_COMMAND,
-#elif defined(__nob_msvc__)
-            "lib",
-#elif defined(__nob_gcc__)
-            "ar -rcs",
-#elif defined(__nob_clang__)
-            "ar -rcs",
-#else
-            ([]() {Log("Error: LibraryCommand used with unknown library archiver. Please define the NOBPP_LIBRARY macro with the location of the library archiver.\n", LogType::Info);return "";})(),
+#if defined(__nob_msvc__) || defined(__nob_clang__)
+        // reads a P1689 scan (what cl -scanDependencies and clang-scan-deps -format=p1689 write)
+        bool ParseModuleScan(const std::string& text, ModuleScan& out)
+        {
+            size_t i = 0;
+            JsonValue root;
+            if (!ParseJson(text, i, root)) return false;
+            const JsonValue* rules = root.Find("rules");
+            if (rules == nullptr || rules->array.empty()) return false;
+
+            out = {};
+            const JsonValue& rule = rules->array[0];
+            if (const JsonValue* provides = rule.Find("provides"))
+            {
+                for (const JsonValue& module : provides->array)
+                {
+                    const JsonValue* name = module.Find("logical-name");
+                    const JsonValue* exported = module.Find("is-interface");
+                    if (name == nullptr) continue;
+                    out.provides = name->str;
+                    out.exported = exported == nullptr || exported->number != 0.0;  // booleans are read as 1 and 0
+                }
+            }
+            if (const JsonValue* required = rule.Find("requires"))
+            {
+                for (const JsonValue& module : required->array)
+                {
+                    const JsonValue* name = module.Find("logical-name");
+                    if (name != nullptr && module.Find("lookup-method") == nullptr) out.imports.push_back(name->str);  // header units have a lookup method
+                }
+            }
+            return true;
+        }
 #endif
-            path })
-    {
-    }
 
-    nob::LibraryCommand::LibraryCommand(Command cmd)
-        : Command(cmd)
-    {
-    }
-
-
-    PrecompiledHeader CreatePrecompiledHeader(CompileCommand cmd, std::filesystem::path header, std::filesystem::path pch)
-    {
-        cmd.UpdateInputTime(header);
-        cmd.UpdateOutputTime(pch);
+        // Scans with the compiler when it can (the textual scan decides whether that is needed, since
+        // starting the scanner for every source costs about as much as preprocessing it).
+        ModuleScan ScanModules(const CompileCommand& job, const std::filesystem::path& source)
+        {
+            ModuleScan ret = ReadModuleDeclarations(source);
+            if (!ret.Uses()) return ret;
 
-        (cmd + IncludeDirectory{ header.parent_path() }
+#if defined(__nob_msvc__) || defined(__nob_clang__)
+            std::vector<std::string> args = SplitArguments(job.text);
+            std::string json;
 #if defined(__nob_msvc__)
-            + std::string("-Yc") - header.filename() + std::string("-Fp") - pch
-#elif defined(__nob_gcc__)
-
-#elif defined(__nob_clang__)
-
+            std::filesystem::path file = job.outputs.empty() ? source.string() + ".json" : job.outputs[0].path.string() + ".json";
+            args.push_back("-scanDependencies");
+            args.push_back(file.string());
+            if (RunProcess(args, job.path).exitCode == 0)
+            {
+                std::ifstream in(file, std::ios::binary);
+                json.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+            }
+            std::error_code ec;
+            std::filesystem::remove(file, ec);
 #else
-
+            if (!FindOnPath({ "clang-scan-deps", "clang-scan-deps.exe" }).empty())
+            {
+                args.insert(args.begin(), { "clang-scan-deps", "-format=p1689", "--" });
+                ProcessResult result = RunProcess(args, job.path);
+                if (result.exitCode == 0) json = result.output;
+            }
 #endif
-        ).Run();
-        return PrecompiledHeader(header, pch);
-    }
-
-    PrecompiledHeader UsePrecompiledHeader(std::filesystem::path header, std::filesystem::path pch)
-    {
-        return PrecompiledHeader(header, pch);
-    }
-
+            ModuleScan scanned;
+            if (json != "" && ParseModuleScan(json, scanned)) return scanned;
+#else
+            (void)job;  // GCC sources keep the textual scan
+#endif
+            return ret;
+        }
 
-    PrecompiledHeader::PrecompiledHeader(std::filesystem::path headerp, std::filesystem::path pchp)
-        : header(headerp), pch(pchp)
-    {
-    }
+        // Scans every source, reusing obj/modules.scan for the ones not written since. Each line there is
+        // source, write time, provided module, 1 for an interface and the imports, separated by tabs.
+        std::unordered_map<std::string, ModuleScan> ScanDirectoryModules(const std::vector<std::filesystem::path>& sources,
+            const std::filesystem::path& obj, const std::function<CompileCommand(const std::filesystem::path&)>& command)
+        {
+            std::filesystem::path cacheFile = obj / "modules.scan";
+            std::unordered_map<std::string, std::pair<int64_t, ModuleScan>> cached;
+            std::ifstream in(cacheFile, std::ios::binary);
+            std::string line;
+            while (std::getline(in, line))
+            {
+                std::vector<std::string> fields;
+                for (size_t start = 0; start <= line.size();)
+                {
+                    size_t end = std::min(line.find('\t', start), line.size());
+                    fields.push_back(line.substr(start, end - start));
+                    start = end + 1;
+                }
+                if (fields.size() < 4) continue;
+                ModuleScan scan{ fields[2], fields[3] == "1", { fields.begin() + 4, fields.end() } };
+                cached[fields[0]] = { std::strtoll(fields[1].c_str(), nullptr, 10), scan };
+            }
+            in.close();
 
+            std::unordered_map<std::string, ModuleScan> ret;
+            std::vector<size_t> stale;
+            std::vector<int64_t> times(sources.size());
+            for (size_t i = 0; i < sources.size(); i++)
+            {
+                times[i] = GetWriteTime(sources[i]);
+                auto it = cached.find(sources[i].string());
+                if (it != cached.end() && it->second.first == times[i]) ret[sources[i].string()] = it->second.second;
+                else stale.push_back(i);
+            }
+            if (stale.empty() && cached.size() == sources.size()) return ret;
 
+            std::vector<ModuleScan> scans(sources.size());
+            ParallelForEach<size_t>(stale, [&](size_t i) { scans[i] = ScanModules(command(sources[i]), sources[i]); });
+            for (size_t i : stale) ret[sources[i].string()] = scans[i];
 
-    CompileCommand operator+(CompileCommand a, SourceFile b)
-    {
-        a.UpdateInputTime(b.path);
+            std::string content;
+            for (size_t i = 0; i < sources.size(); i++)
+            {
+                const ModuleScan& scan = ret[sources[i].string()];
+                content += sources[i].string() + "\t" + std::to_string(times[i]) + "\t" + scan.provides + "\t" + (scan.exported ? "1" : "0");
+                for (const std::string& module : scan.imports) content += "\t" + module;
+                content += "\n";
+            }
+            std::error_code ec;
+            std::filesystem::create_directories(obj, ec);
+            std::ofstream(cacheFile, std::ios::binary) << content;
+            return ret;
+        }
 
+        std::filesystem::path ModuleFile(const std::filesystem::path& obj, std::string name)  // the BMI of a module
+        {
+            std::replace(name.begin(), name.end(), ':', '-');
 #if defined(__nob_msvc__)
-        return a + b.path;
+            return obj / (name + ".ifc");
 #elif defined(__nob_gcc__)
-        return a + b.path;
-#elif defined(__nob_clang__)
-        return a + b.path;
+            return obj / (name + ".gcm");
 #else
-        return a + b.path;
+            return obj / (name + ".pcm");
 #endif
-    }
+        }
 
-    CompileCommand operator+(CompileCommand a, ObjectFile b)
-    {
-        a.UpdateOutputTime(b.path);
+        // Makes each job write the BMI of the module it provides and read the BMIs of the modules it imports
+        // (and of what those import, since the compiler loads them too). Modules nobody here provides, like
+        // std, are left to the compiler.
+        void AddModules(std::vector<CompileCommand>& jobs, const std::vector<ModuleScan>& scans, const std::filesystem::path& obj)
+        {
+            std::unordered_map<std::string, size_t> providers;
+            for (size_t i = 0; i < jobs.size(); i++)
+            {
+                if (scans[i].provides == "") continue;
+                auto [it, inserted] = providers.insert({ scans[i].provides, i });
+                if (!inserted) Log("Module " + scans[i].provides + " is provided by two sources, so one of them is ignored.\n", LogType::Error);
+            }
 
-#if defined(__nob_msvc__)
-        return a + std::string("-Fo") - b.path;
-#elif defined(__nob_gcc__)
-        return a + std::string("-o") + b.path;
-#elif defined(__nob_clang__)
-        return a + std::string("-o") + b.path;
-#else
-        return a + std::string("-o") + b.path;
+#if defined(__nob_gcc__)
+            // GCC looks modules up in one mapper file, written only when a module was added or removed
+            std::filesystem::path mapper = std::filesystem::absolute(obj / "module.map");
+            std::vector<std::string> lines;
+            for (auto& [name, i] : providers) lines.push_back(name + " " + std::filesystem::absolute(ModuleFile(obj, name)).string() + "\n");
+            std::sort(lines.begin(), lines.end());
+            std::string content;
+            for (const std::string& line : lines) content += line;
+            std::ifstream in(mapper, std::ios::binary);
+            std::string old((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+            in.close();
+            if (old != content)
+            {
+                std::error_code ec;
+                std::filesystem::create_directories(obj, ec);
+                std::ofstream(mapper, std::ios::binary) << content;
+            }
 #endif
-    }
 
-    CompileCommand operator+(CompileCommand a, IncludeDirectory b)
-    {
+            for (size_t i = 0; i < jobs.size(); i++)
+            {
+                const ModuleScan& scan = scans[i];
+                if (!scan.Uses()) continue;
+
+                std::vector<std::string> imports;
+                std::unordered_set<std::string> seen;
+                std::vector<std::string> pending = scan.imports;
+                while (!pending.empty())
+                {
+                    std::string name = pending.back();
+                    pending.pop_back();
+                    auto it = providers.find(name);
+                    if (!seen.insert(name).second || it == providers.end() || it->second == i) continue;
+                    imports.push_back(name);
+                    pending.insert(pending.end(), scans[it->second].imports.begin(), scans[it->second].imports.end());
+                }
+                if (imports.empty() && scan.provides == "") continue;  // it only imports modules from elsewhere
+
+                CompileCommand& job = jobs[i];
+#if defined(__nob_gcc__)
+                job = job + CustomCompilerFlag{ "-fmodules-ts" } + CustomCompilerFlag{ "\"-fmodule-mapper=" + mapper.string() + "\"" };
+#endif
+                if (scan.provides != "")
+                {
+                    std::filesystem::path bmi = ModuleFile(obj, scan.provides);
 #if defined(__nob_msvc__)
-        return a + std::string("-I") - b.path;
-#elif defined(__nob_gcc__)
-        return a + std::string("-I") - b.path;
+                    job = job + CustomCompilerFlag{ scan.exported ? "-interface" : "-internalPartition" } + CustomCompilerFlag{ "-ifcOutput \"" + bmi.string() + "\"" };
 #elif defined(__nob_clang__)
-        return a + std::string("-I") - b.path;
-#else
-        return a + std::string("-I") - b.path;
+                    job = job + CustomCompilerFlag{ "\"-fmodule-output=" + bmi.string() + "\"" };
 #endif
-    }
-
-    CompileCommand operator+(CompileCommand a, MacroDefinition b)
-    {
+                    job.UpdateOutputTime(bmi);
+                }
+                for (const std::string& name : imports)
+                {
+                    std::filesystem::path bmi = ModuleFile(obj, name);
 #if defined(__nob_msvc__)
-        return a + ("-D\"" + b.macro + "=" + b.definition + "\"");
-#elif defined(__nob_gcc__)
-        return a + ("-D\"" + b.macro + "=" + b.definition + "\"");
+                    job = job + CustomCompilerFlag{ "-reference \"" + name + "=" + bmi.string() + "\"" };
 #elif defined(__nob_clang__)
-        return a + ("-D\"" + b.macro + "=" + b.definition + "\"");
-#else
-        return a + ("-D\"" + b.macro + "=" + b.definition + "\"");
+                    job = job + CustomCompilerFlag{ "\"-fmodule-file=" + name + "=" + bmi.string() + "\"" };
 #endif
-    }
+                    job.UpdateInputTime(bmi);
+                }
+            }
+        }
 
-    CompileCommand operator+(CompileCommand a, PrecompiledHeader b)
-    {
-        a.UpdateInputTime(b.header);
-        a.UpdateInputTime(b.pch);
+        // jobs in order, except that each one comes after the jobs writing the BMIs it reads
+        std::vector<size_t> ModuleOrder(const std::vector<CompileCommand>& jobs, std::vector<size_t> order)
+        {
+            std::unordered_map<std::string, size_t> writers;
+            for (size_t i = 0; i < jobs.size(); i++)
+            {
+                for (const TrackedFile& output : jobs[i].outputs)
+                {
+                    if (IsModuleFile(output.path)) writers[output.path.string()] = i;
+                }
+            }
 
-#if defined(__nob_msvc__)
-        return a + IncludeDirectory{ b.header.parent_path() } + std::string("-Yu") - b.header.filename()  + std::string("-Fp") - b.pch;
-#elif defined(__nob_gcc__)
-        return a;
-#elif defined(__nob_clang__)
-        return a;
-#else
-        return a;
-#endif
-    }
+            std::vector<int> depth(jobs.size(), -1);
+            std::function<int(size_t)> visit = [&](size_t i)
+                {
+                    if (depth[i] >= 0) return depth[i];
+                    depth[i] = 0;  // stops an import cycle, which the compiler reports
+                    int ret = 0;
+                    for (const TrackedFile& input : jobs[i].inputs)
+                    {
+                        auto it = writers.find(input.path.string());
+                        if (it != writers.end() && it->second != i) ret = std::max(ret, visit(it->second) + 1);
+                    }
+                    return depth[i] = ret;
+                };
+            std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return visit(a) < visit(b); });
+            return order;
+        }
 
-    CompileCommand operator+(CompileCommand a, CompilerFlag b)
-    {
-#if defined(NOBPP_CUSTOM_COMPILER_FLAG_HANDLER)
-        return a + NOBPP_CUSTOM_COMPILER_FLAG_HANDLER(b);
-#else
-        switch (b)
+        // sources, if set, gets the source file of each command
+        std::vector<CompileCommand> DirectoryCompileCommands(std::filesystem::path src, std::filesystem::path obj, CompileCommand cmd, const CompileDirectoryOptions& options,
+            std::vector<std::filesystem::path>* sources = nullptr)
         {
+            std::vector<std::filesystem::path> out;
+
+            // get all of the sources (and module interfaces), with the file type the walk already read
+            for (const std::filesystem::directory_entry& entry : std::filesystem::recursive_directory_iterator(src))
+            {
+                std::error_code ec;
+                const std::filesystem::path& p = entry.path();
+                std::string extension = p.extension().string();
+                bool wanted = std::find(options.extensions.begin(), options.extensions.end(), extension) != options.extensions.end();
+                if (!entry.is_regular_file(ec) || (!wanted && !(options.modules && IsModuleInterface(p)))) continue;
+                CacheFileTime(entry);
+                out.push_back(p);
+            }
+
+            auto command = [&](const std::filesystem::path& p)
+                {
+                    if (!IsModuleInterface(p)) return cmd + SourceFile{ p } + ObjectFile{ DirectoryObjectFile(src, obj, p) };
+
+                    CompileCommand job = cmd;
 #if defined(__nob_msvc__)
-        case CompilerFlag::OptimizeSpeed: return a + std::string("-O2"); break;
-        case CompilerFlag::OptimizeSpace: return a + std::string("-O1"); break;
-        case CompilerFlag::Debug: return a + std::string("-Zi"); break;
-        case CompilerFlag::CPPVersion14: return a + std::string("-std:c++14"); break;
-        case CompilerFlag::CPPVersion17: return a + std::string("-std:c++17"); break;
-        case CompilerFlag::CPPVersion20: return a + std::string("-std:c++20"); break;
+                    if (p.extension() != ".ixx") job = job + CustomCompilerFlag{ "-TP" };
 #elif defined(__nob_gcc__)
-        case CompilerFlag::OptimizeSpeed: return a + std::string("-O2"); break;
-        case CompilerFlag::OptimizeSpace: return a + std::string("-Os"); break;
-        case CompilerFlag::Debug: return a + std::string("-g"); break;
-        case CompilerFlag::CPPVersion14: return a + std::string("-std=c++14"); break;
-        case CompilerFlag::CPPVersion17: return a + std::string("-std=c++17"); break;
-        case CompilerFlag::CPPVersion20: return a + std::string("-std=c++20"); break;
+                    job = job + CustomCompilerFlag{ "-x c++" };
 #elif defined(__nob_clang__)
-        case CompilerFlag::OptimizeSpeed: return a + std::string("-O2"); break;
-        case CompilerFlag::OptimizeSpace: return a + std::string("-Os"); break;
-        case CompilerFlag::Debug: return a + std::string("-g"); break;
-        case CompilerFlag::CPPVersion14: return a + std::string("-std=c++14"); break;
-        case CompilerFlag::CPPVersion17: return a + std::string("-std=c++17"); break;
-        case CompilerFlag::CPPVersion20: return a + std::string("-std=c++20"); break;
+                    if (p.extension() != ".cppm") job = job + CustomCompilerFlag{ "-x c++-module" };
 #endif
+                    return job + SourceFile{ p } + ObjectFile{ DirectoryObjectFile(src, obj, p) };
+                };
 
-#if defined(_WIN32)
-        case CompilerFlag::PositionIndependentCode: return a; break;
-#else
-        case CompilerFlag::PositionIndependentCode: return a + CustomCompilerFlag{ "-fPIC" }; break;
-#endif
+            std::unordered_map<std::string, ModuleScan> scans;
+            std::vector<std::filesystem::path> modular;  // kept out of unity batches, which cannot hold a module unit
+            if (options.modules)
+            {
+                scans = ScanDirectoryModules(out, obj, command);
+                auto split = std::stable_partition(out.begin(), out.end(), [&](const std::filesystem::path& p) { return !scans[p.string()].Uses(); });
+                modular.assign(split, out.end());
+                out.erase(split, out.end());
+            }
 
+            std::vector<CompileCommand> ret;
+            std::vector<ModuleScan> retScans;
+            if (options.unity)
+            {
+                std::sort(out.begin(), out.end());  // the same batches every run
+                std::vector<std::filesystem::path> singles;
+                for (auto& [unityFile, files] : GroupUnityFiles(out, src, obj, options, singles))
+                {
+                    // the sources it includes come back through the dependency file
+                    ret.push_back(cmd + SourceFile{ unityFile } + ObjectFile{ std::filesystem::path(unityFile).replace_extension(".obj") });
+                    retScans.push_back({});
+                    if (sources) sources->push_back(unityFile);
+                }
+                out = singles;
+            }
+            out.insert(out.end(), modular.begin(), modular.end());
 
-        case CompilerFlag::KeepLinker:
-        {
-            size_t loc = a.text.find(" -c");
-            if (loc == std::string::npos)
+            for (std::filesystem::path& p : out)
             {
-                return a;
+                ret.push_back(command(p));
+                retScans.push_back(scans[p.string()]);
+                if (sources) sources->push_back(p);
             }
-            else
+            if (!modular.empty()) AddModules(ret, retScans, obj);
+
+            // compilers do not create the directory of the object, so each directory of the mirrored tree is made once here
+            std::unordered_set<std::string> directories;
+            for (const CompileCommand& job : ret)
             {
-                a.text = a.text.substr(0, loc) + a.text.substr(loc + 3);
-                return a;
+                std::filesystem::path directory = job.outputs[0].path.parent_path();
+                std::error_code ec;
+                if (directories.insert(directory.string()).second) std::filesystem::create_directories(directory, ec);
             }
+            WriteObjectManifest(src, obj, ret);
+            return ret;
         }
-        case CompilerFlag::NoObjectFile:
+
+#if defined(__nob_msvc__)
+        // Compiles the sources of jobs (made by DirectoryCompileCommands from cmd) in one cl process whose
+        // objects land in scratch (cl can only name them after their stems) and are moved to the jobs' objects,
+        // then logs, caches and writes the dependency file of each job as if it had run alone
+        int RunCompileBatch(CompileCommand cmd, std::filesystem::path scratch, std::vector<CompileCommand*> jobs, std::vector<std::filesystem::path> sources,
+            std::vector<uint64_t> cacheKeys, unsigned int parallel)
         {
-            size_t loc = a.text.find(" ");
+            std::error_code ec;
+            std::filesystem::create_directories(scratch, ec);
+            if (parallel > 1)
+            {
+                cmd += std::string("-MP") + std::to_string(parallel);
+            }
+            for (const std::filesystem::path& source : sources)
+            {
+                cmd += SourceFile{ source };
+            }
 
-            // perform surgery so that this command is always overriden if + ObjectFile is used
-            std::string tmp = a.text.substr(loc);
-            a.text = a.text.substr(0, loc);
-            a = a + ObjectFile{ std::filesystem::temp_directory_path() / "nobDeletedObj.o" };
-            a.text += tmp;
-            return a;
-        }
-        default:
-            Log("CompilerFlag is not supported by your compiler.\n", LogType::Info); return a;
-            break;
-        }
-#endif
-    }
+            // a directory ends in a backslash, which is written doubled so it does not escape the quote
+            std::string directory = std::filesystem::path(scratch).make_preferred().string() + "\\\\";
+            cmd += "-Fo\"" + directory + "\"";
+            cmd += "-sourceDependencies \"" + directory + "\"";  // -showIncludes output cannot be told apart once -MP interleaves it
 
-    CompileCommand operator+(CompileCommand a, CustomCompilerFlag b)
-    {
-        return (Command)a + b.flag;
-    }
+            std::vector<std::vector<RecordedFile>> inputTimes;
+            for (CompileCommand* job : jobs)
+            {
+                inputTimes.push_back(InputTimes(*job));
+                std::filesystem::remove(job->outputs[0].path, ec);  // may be a link to a cache entry
+            }
 
-    LinkCommand AddDefaultOutputToLinker(CompileCommand a, LinkCommand b)
-    {
-        if (b.text.find(" -o") != std::string::npos)
-        {
-            return b;
-        }
-        else
-        {
-            for (int i = 0; i < a.text.size() - 1; i++)
+            int64_t started = FileClockNow();
+            ProcessResult ret = cmd.Execute();
+
+            for (size_t i = 0; i < jobs.size(); i++)
             {
-                if (a.text[i] == ' ' and a.text[i + 1] != ' ' and a.text[i + 1] != '-')
-                {  // an argument with no - prefix is a source file
-                    std::filesystem::path file;
+                CompileCommand& job = *jobs[i];
+                std::filesystem::rename(scratch / std::filesystem::path(sources[i].filename()).replace_extension(".obj"), job.outputs[0].path, ec);
+                InvalidateFileTime(job.outputs[0].path);
+                std::filesystem::path json = scratch / (sources[i].filename().string() + ".json");
+                std::ifstream in(json, std::ios::binary);
+                std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+                in.close();
+                std::filesystem::remove(json, ec);
+
+                JsonValue root;
+                size_t pos = 0;
+                const JsonValue* data = nullptr;
+                const JsonValue* includes = nullptr;
+                if (ret.exitCode != 0 || text == "" || !ParseJson(text, pos, root) || !(data = root.Find("Data")) || !(includes = data->Find("Includes")))
+                {
+                    continue;  // not logged, so it is compiled again next time
+                }
 
-                    if (a.text[i + 1] == '"')
-                    {
-                        file = a.text.substr(i + 2, a.text.substr(i + 2).find('"'));
-                    }
-                    else
+                std::string deps;
+                for (const JsonValue& include : includes->array)
+                {
+                    for (char c : include.str)
                     {
-                        file = a.text.substr(i + 1, a.text.substr(i + 1).find(' '));
+                        if (c == ' ') deps += "\\ ";
+                        else deps += c;
                     }
-#ifdef _WIN32
-                    file = file.replace_extension("exe");
-#else
-                    file = file.replace_extension("");
-#endif
-                    return b + ExecutableFile{ file };
+                    deps += " \\\n";
                 }
-            }
+                std::ofstream(job.dependencyFile) << job.dependencyFile.stem().string() << ".obj: \\\n" << deps << "\n";
 
-            return b;
+                RecordBuild(job, std::move(inputTimes[i]), started, ret.seconds / jobs.size(), ret.peakMemory);
+                if (cacheKeys[i] != 0)
+                {
+                    DefaultObjectCache.Store(cacheKeys[i], job.outputs[0].path, job.dependencyFile);
+                }
+            }
+            std::filesystem::remove_all(scratch, ec);
+            return ret.exitCode;
         }
+#endif
     }
 
-    CompileCommand operator+(CompileCommand a, AddLinkCommand b)
+    int CompileDirectory(std::filesystem::path src, std::filesystem::path obj, CompileCommand cmd, bool runAsync)
     {
-#if defined(__nob_msvc__)
-        return a + CompilerFlag::KeepLinker + CompilerFlag::NoObjectFile + AddDefaultOutputToLinker(a, b.lc).text.substr(b.lc.text.find("-link"));
-#elif defined(__nob_gcc__)
-        return a + CompilerFlag::KeepLinker + CompilerFlag::NoObjectFile + AddDefaultOutputToLinker(a, b.lc).text.substr(b.lc.text.find(" "));
-#elif defined(__nob_clang__)
-        return a + CompilerFlag::KeepLinker + CompilerFlag::NoObjectFile + AddDefaultOutputToLinker(a, b.lc).text.substr(b.lc.text.find(" "));
-#else
-        return a + CompilerFlag::KeepLinker + CompilerFlag::NoObjectFile + AddDefaultOutputToLinker(a, b.lc).text.substr(b.lc.text.find(" "));
-#endif
+        return CompileDirectory(src, obj, CompileDirectoryOptions{}, cmd, runAsync);
     }
 
-    LinkCommand operator+(LinkCommand a, ObjectFile b)
+    int CompileDirectory(std::filesystem::path src, std::filesystem::path obj, CompileDirectoryOptions options, CompileCommand cmd, bool runAsync)
     {
-        a.UpdateInputTime(b.path);
+        if (options.precompiledHeader != "")
+        {
+            std::filesystem::create_directories(obj);
+            cmd += CreatePrecompiledHeader(cmd, options.precompiledHeader, DirectoryPrecompiledHeader(obj, options.precompiledHeader));
+        }
+        if (CLFlags[CLArgument::ReportTime])
+        {
+            cmd += CompilerFlag::TimeTrace;
+        }
 
-#if defined(__nob_msvc__)
-        size_t pos = a.text.find("-link");
-        a.text = a.text.substr(0, pos) + "\"" + b.path.string() + "\" " + a.text.substr(pos);
-        return a;
-#elif defined(__nob_gcc__)
-        return a + b.path;
-#elif defined(__nob_clang__)
-        return a + b.path;
-#else
-        return a + b.path;
-#endif
-    }
+        std::vector<std::filesystem::path> sources;
+        std::vector<CompileCommand> jobs = DirectoryCompileCommands(src, obj, cmd, options, &sources);
 
-    LinkCommand operator+(LinkCommand a, StaticLibraryFile b)
-    {
-        a.UpdateInputTime(b.path, true);
+        if (DefaultObjectCache.remote && DefaultObjectCache.directory != "")
+        {
+            // ask the remote cache for every stale object in one batch instead of one round trip per compile
+            std::vector<CompileCommand*> stale;
+            for (CompileCommand& job : jobs)
+            {
+                if (job.dependencyFile != "" && job.outputs.size() == 1 && !job.IsUpToDate()) stale.push_back(&job);
+            }
 
-        if (b.path.extension().string() == "a" or b.path.extension().string() == "lib")
+            std::vector<uint64_t> keys(stale.size());
+            std::vector<char> found(stale.size());
+            std::vector<size_t> indices(stale.size());
+            for (size_t i = 0; i < indices.size(); i++) indices[i] = i;
+            ParallelForEach<size_t>(indices, [&](size_t i) { found[i] = DefaultObjectCache.GetKey(*stale[i], keys[i]); });
+
+            std::vector<uint64_t> wanted;
+            for (size_t i = 0; i < keys.size(); i++)
+            {
+                if (found[i]) wanted.push_back(keys[i]);
+            }
+            DefaultObjectCache.Prefetch(wanted);
+        }
+
+        std::vector<const Command*> pointers;
+        for (CompileCommand& job : jobs) pointers.push_back(&job);
+        std::vector<double> durations = EstimateDurations(pointers);
+
+        // compile all of the cpp files, longest first so a slow source does not end up alone at the end
+        std::vector<size_t> order(jobs.size());
+        for (size_t i = 0; i < order.size(); i++) order[i] = i;
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return durations[a] > durations[b]; });
+
+        if (std::any_of(jobs.begin(), jobs.end(), [](const CompileCommand& job) { return UsesModules(job); }))
         {
-#if defined(_WIN32)
-            b.path.replace_extension("lib");
-#else
-            b.path.replace_extension("a");
-#endif
+            if (runAsync)
+            {
+                // the graph starts each source once the interfaces it imports are built
+                BuildGraph graph;
+                for (size_t i : order) graph.Add(jobs[i]);
+                return graph.Run();
+            }
+            order = ModuleOrder(jobs, order);
+            options.batch = false;
         }
 
+        // jobs run here still count towards the pool's FailureLimit, so the link after them is not started either
+        int ret = 0;
+        auto keepGoing = [&](int result)
+            {
+                if (ret == 0) ret = result;
+                return DefaultJobPool.Report(result);
+            };
+
 #if defined(__nob_msvc__)
-        return a + b.path;
-#elif defined(__nob_gcc__)
-        return a + b.path;
-#elif defined(__nob_clang__)
-        return a + b.path;
-#else
-        return a + b.path;
-#endif
-    }
+        if (options.batch)
+        {
+            // the stale sources are dealt out longest first, so every batch gets a similar share of the work
+            std::vector<size_t> stale;
+            std::vector<size_t> rest;
+            for (size_t i : order)
+            {
+                // the key preprocesses the source, so it is only worth taking for the ones that are out of date
+                uint64_t key = 0;
+                bool stay = jobs[i].IsUpToDate() || (DefaultObjectCache.directory != "" && DefaultObjectCache.GetKey(jobs[i], key) && DefaultObjectCache.Contains(key));
+                (stay ? rest : stale).push_back(i);  // cache hits are restored one by one below
+            }
 
-    LinkCommand operator+(LinkCommand a, DynamicLibraryFile b)
-    {
-#if defined(_WIN32)
-        b.path.replace_extension("dll");
-#elif defined(__APPLE__)
-        b.path.replace_extension("dylib");
-#else
-        b.path.replace_extension("so");
-#endif
-        return a + StaticLibraryFile{ b.path };
-    }
+            size_t batchCount = options.batchSize != 0 ? (stale.size() + options.batchSize - 1) / options.batchSize : runAsync ? JobCount : 1;
+            batchCount = std::min(batchCount, stale.size());
+            std::vector<std::vector<size_t>> batches(batchCount);
+            for (size_t i = 0; i < stale.size(); i++)
+            {
+                // cl names the objects after the sources' stems, so a second util.* in a batch is compiled on its own
+                std::vector<size_t>& batch = batches[i % batchCount];
+                bool clash = std::any_of(batch.begin(), batch.end(), [&](size_t j) { return sources[j].stem() == sources[stale[i]].stem(); });
+                (clash ? rest : batch).push_back(stale[i]);
+            }
 
-    LinkCommand operator+(LinkCommand a, ExecutableFile b)
-    {
-        a.UpdateOutputTime(b.path);
+            for (size_t b = 0; b < batches.size(); b++)
+            {
+                std::vector<size_t>& batch = batches[b];
+                std::vector<CompileCommand*> batchJobs;
+                std::vector<std::filesystem::path> batchSources;
+                std::vector<uint64_t> keys;
+                double seconds = 0.0;
+                for (size_t i : batch)
+                {
+                    uint64_t key = 0;
+                    if (DefaultObjectCache.directory == "" || !DefaultObjectCache.GetKey(jobs[i], key)) key = 0;
+                    batchJobs.push_back(&jobs[i]);
+                    batchSources.push_back(sources[i]);
+                    keys.push_back(key);
+                    seconds += durations[i];
+                }
 
-#if defined(__nob_msvc__)
-        return a + std::string("-out:") - b.path;
-#elif defined(__nob_gcc__)
-        return a + std::string("-o") + b.path;
-#elif defined(__nob_clang__)
-        return a + std::string("-o") + b.path;
-#else
-        return a + std::string("-o") + b.path;
+                // one process per pool slot when async, otherwise cl runs the sources on JobCount processes of its own
+                unsigned int parallel = runAsync ? 1 : std::min<unsigned int>(JobCount, (unsigned int)batch.size());
+                std::filesystem::path scratch = obj / ("nobpp_batch_" + std::to_string(b));
+                auto run = [=]() { return RunCompileBatch(cmd, scratch, batchJobs, batchSources, keys, parallel); };
+                if (runAsync)
+                {
+                    DefaultJobPool.Submit(run, seconds);
+                }
+                else if (!keepGoing(run()))
+                {
+                    return ret;
+                }
+            }
+            order = rest;
+        }
 #endif
-    }
 
-    LinkCommand operator+(LinkCommand a, LinkerFlag b)
-    {
-#if defined(NOBPP_CUSTOM_LINKER_FLAG_HANDLER)
-        return a + NOBPP_CUSTOM_LINKER_FLAG_HANDLER(b);
-#else
-        switch (b)
+        for (size_t i : order)
         {
-#if defined(__nob_msvc__)
-        case LinkerFlag::OutputDynamicLibrary: return a + std::string("-dll"); break;
-        case LinkerFlag::Debug: return a + std::string("-debug"); break;
-#elif defined(__nob_gcc__)
-        case LinkerFlag::OutputDynamicLibrary: return a + std::string("-shared"); break;
-        case LinkerFlag::Debug: return a + std::string("-g"); break;
-#elif defined(__nob_clang__)
-        case LinkerFlag::OutputDynamicLibrary: return a + std::string("-shared"); break;
-        case LinkerFlag::Debug: return a + std::string("-g"); break;
-#endif
-        default:
-            Log("LinkerFlag is not supported by your compiler.\n", LogType::Info); return a;
-            break;
+            CompileCommand& job = jobs[i];
+            if (runAsync)
+            {
+                DefaultJobPool.Submit(job, false, durations[i]);
+            }
+            else if (!keepGoing(job.Run()))
+            {
+                return ret;
+            }
         }
-#endif
+
+        return runAsync ? DefaultJobPool.Wait() : ret;
     }
 
-    LinkCommand operator+(LinkCommand a, CustomLinkerFlag b)
+    int LinkDirectory(std::filesystem::path obj, std::filesystem::path exe, LinkCommand cmd)
     {
-        return (Command)a + b.flag;
+        // what CompileDirectory made, if it made anything here, otherwise every object in obj
+        bool listed = false;
+        for (auto& [source, object] : ReadObjectManifest(obj, listed))
+        {
+            cmd += ObjectFile{ obj / object };
+        }
+        if (!listed)
+        {
+            for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(obj))
+            {
+                if (entry.path().extension() == ".obj" || entry.path().extension() == ".o")  // skip the .d files next to them
+                {
+                    CacheFileTime(entry);
+                    cmd += ObjectFile{ entry.path() };
+                }
+            }
+        }
+        cmd += ExecutableFile{exe};
+        return DefaultJobPool.Submit(cmd).get();  // takes a pool slot, so links started from other threads are bounded too
     }
 
+    void CompileDirectory(BuildGraph& graph, std::filesystem::path src, std::filesystem::path obj, CompileCommand cmd)
+    {
+        CompileDirectory(graph, src, obj, CompileDirectoryOptions{}, cmd);
+    }
 
-    LibraryCommand operator+(LibraryCommand a, ObjectFile b)
+    void CompileDirectory(BuildGraph& graph, std::filesystem::path src, std::filesystem::path obj, CompileDirectoryOptions options, CompileCommand cmd)
     {
-        a.UpdateInputTime(b.path);
+        if (options.precompiledHeader != "")
+        {
+            // the graph orders the sources after the pch, because the pch is one of their inputs
+            std::filesystem::create_directories(obj);
+            std::filesystem::path pch = DirectoryPrecompiledHeader(obj, options.precompiledHeader);
+            graph.Add(PrecompiledHeaderCommand(cmd, options.precompiledHeader, pch));
+            cmd += UsePrecompiledHeader(options.precompiledHeader, pch);
+        }
+        if (CLFlags[CLArgument::ReportTime])
+        {
+            cmd += CompilerFlag::TimeTrace;
+        }
 
-        return a + b.path;
+        for (CompileCommand& job : DirectoryCompileCommands(src, obj, cmd, options))
+        {
+            graph.Add(job);
+        }
     }
 
-    LibraryCommand operator+(LibraryCommand a, StaticLibraryFile b)
+    void LinkDirectory(BuildGraph& graph, std::filesystem::path obj, std::filesystem::path exe, LinkCommand cmd)
     {
-        a.UpdateOutputTime(b.path);
+        // the objects may not exist yet, so take them from the commands that will write them
+        std::filesystem::path directory = std::filesystem::absolute(obj).lexically_normal();
+        for (Command& node : graph.nodes)
+        {
+            for (TrackedFile& output : node.outputs)
+            {
+                std::filesystem::path p = std::filesystem::absolute(output.path).lexically_normal();
+                std::filesystem::path relative = p.lexically_relative(directory);
+                if (!relative.empty() && *relative.begin() != ".." && (p.extension() == ".obj" || p.extension() == ".o"))
+                {
+                    cmd += ObjectFile{ output.path };
+                }
+            }
+        }
+        graph.Add(cmd + ExecutableFile{ exe });
+    }
 
+    int MergeProfiles(std::filesystem::path profile)
+    {
+        std::error_code ec;
 #if defined(__nob_msvc__)
-        return a + std::string("-out:") - b.path;
+        // pgomgr merges every name!N.pgc next to name.pgd, and would count them again after the next training
+        int ret = (Command() + std::string(NOBPP_PROFILE_MERGE_TOOL) + std::string("-merge") + profile).Run();
+        InvalidateFileTime(profile);
+        std::string prefix = profile.stem().string() + "!";
+        for (const std::filesystem::path& file : std::filesystem::directory_iterator(std::filesystem::absolute(profile).parent_path(), ec))
+        {
+            if (file.extension() == ".pgc" && file.filename().string().rfind(prefix, 0) == 0) std::filesystem::remove(file, ec);
+        }
+        return ret;
 #else
-        return a + b.path;
+        std::vector<std::filesystem::path> raw;
+        for (const std::filesystem::path& file : std::filesystem::recursive_directory_iterator(RawProfileDirectory(profile), ec))
+        {
+            if (file.extension() == ".profraw" || file.extension() == ".gcda") raw.push_back(file);  // GCC recreates the object's absolute path under it
+        }
+        if (raw.empty())
+        {
+            Log("No profiles were written to " + RawProfileDirectory(profile).string() + ". Did the training run the instrumented build?\n", LogType::Error);
+            return 1;
+        }
+        std::sort(raw.begin(), raw.end());
+
+  #if defined(__nob_gcc__)
+        // GCC reads the .gcda files where they are, so profile only lists them, to be an input that changes with them
+        std::string list;
+        for (const std::filesystem::path& file : raw)
+        {
+            list += file.string() + " " + std::to_string(HashFile(file)) + "\n";
+        }
+        std::ifstream in(profile, std::ios::binary);
+        std::string previous((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        in.close();
+        if (previous != list)
+        {
+            std::ofstream(profile, std::ios::binary) << list;
+            InvalidateFileTime(profile);
+        }
+        return 0;
+  #else
+        Command merge = Command() + std::string(NOBPP_PROFILE_MERGE_TOOL) + std::string("merge") + std::string("-output=") - profile;
+        for (const std::filesystem::path& file : raw)
+        {
+            merge += file;
+        }
+        int ret = merge.Run();
+        InvalidateFileTime(profile);
+        return ret;
+  #endif
 #endif
     }
 
-
-
-    void CompileDirectory(std::filesystem::path src, std::filesystem::path obj, CompileCommand cmd, bool runAsync)
+    int ProfileGuidedBuild(std::filesystem::path profile, Command train, std::function<int(CompileCommand compile, LinkCommand link, bool instrumented)> build, bool retrain)
     {
-        std::vector<std::filesystem::path> out;
+        std::error_code ec;
+        if (retrain || !std::filesystem::exists(profile, ec))
+        {
+        #if !defined(__nob_msvc__)
+            // profiles of an older build would be merged in, and GCC would reject the ones that do not match the code
+            std::filesystem::remove_all(RawProfileDirectory(profile), ec);
+            std::filesystem::create_directories(RawProfileDirectory(profile), ec);
+        #endif
+            int ret = build(DefaultCompileCommand + ProfileGenerate{ profile }, DefaultLinkCommand + ProfileGenerate{ profile }, true);
+            if (ret != 0) return ret;
 
-        // get all of the cpp files
-        std::copy_if(std::filesystem::recursive_directory_iterator(src), std::filesystem::recursive_directory_iterator{}, std::back_inserter(out),
-            [](std::filesystem::path p)
+            Log("Training the instrumented build.\n", LogType::Info);
+            ret = train.Run(false, true);
+            if (ret != 0)
             {
-                return std::filesystem::is_regular_file(p) && p.string().substr(p.string().size() - 4) == ".cpp";
+                Log("Training failed, so the profile was not updated.\n", LogType::Error);
+                return ret;
             }
-        );
-
-        // compile all of the cpp files
-        nob::ParallelForEach(out, std::function([obj,cmd](std::filesystem::path p)
-                {
-                    (cmd + SourceFile{p} + ObjectFile{obj / p.filename().replace_extension(".obj") }).Run();
-                }), runAsync
-        );
-    }
 
-    void LinkDirectory(std::filesystem::path obj, std::filesystem::path exe, LinkCommand cmd)
-    {
-        for (std::filesystem::path p : std::filesystem::directory_iterator(obj))
-        {
-            cmd = cmd + ObjectFile{p};
+            ret = MergeProfiles(profile);
+            if (ret != 0) return ret;
         }
-        cmd = cmd + ExecutableFile{exe};
-        cmd.Run();
+
+        return build(DefaultCompileCommand + ProfileUse{ profile }, DefaultLinkCommand + ProfileUse{ profile }, false);
     }
 
 
@@ -1032,6 +6598,18 @@ namespace nob
     std::bitset<CLArgument::Count> CLFlags;
     std::vector<std::string> OtherCLArguments;
     std::filesystem::path ThisExecutablePath;
+    unsigned int JobCount = std::max(std::thread::hardware_concurrency(), 1u);
+    unsigned int LinkJobCount = 0;
+    uint64_t MemoryBudget = AvailableMemory();
+    unsigned int FailureLimit = 1;
+    bool KillOnFailure = false;
+    DebugInfo DebugInfoMode = DebugInfo::Full;
+    JobPool DefaultJobPool;
+    BuildLog DefaultBuildLog;
+    BuildTrace DefaultBuildTrace;
+    TimeReport DefaultTimeReport;
+    ObjectCache DefaultObjectCache{ { NOBPP_CACHE_DIRECTORY }, (uint64_t)NOBPP_CACHE_SIZE_LIMIT * 1024 * 1024, NOBPP_REMOTE_CACHE_URL };
+    RemoteCompilers DefaultRemoteCompilers{ NOBPP_REMOTE_WORKERS };
 
 
     Command AddArgs(Command cmd, int argc, char** argv)
@@ -1039,7 +6617,7 @@ namespace nob
         for (int i = 1; i < argc; i++)
         {
             if (std::string(argv[i]) == "-configure") continue;
-            cmd = cmd + ("\"" + std::string(argv[i]) + "\"");
+            cmd += ("\"" + std::string(argv[i]) + "\"");
         }
         return cmd;
     }
@@ -1072,6 +6650,11 @@ namespace nob
             {
                 CLFlags.set(CLArgument::Debug);
             }
+            else if (std::string(argv[i]) == "-debug=split" || std::string(argv[i]) == "-debug=compressed")
+            {
+                CLFlags.set(CLArgument::Debug);
+                DebugInfoMode = std::string(argv[i]) == "-debug=split" ? DebugInfo::Split : DebugInfo::Compressed;
+            }
             else if (std::string(argv[i]) == "-silent")
             {
                 CLFlags.set(CLArgument::Silent);
@@ -1080,6 +6663,64 @@ namespace nob
             {
                 CLFlags.set(CLArgument::Clean);
             }
+            else if ((std::string(argv[i]) == "-linkjobs" || std::string(argv[i]) == "-memory") && i + 1 < argc)
+            {
+                std::string flag = argv[i];
+                std::string count = argv[++i];
+                try
+                {
+                    if (flag == "-linkjobs") LinkJobCount = (unsigned int)std::max(std::stoi(count), 0);
+                    else MemoryBudget = (uint64_t)std::max(std::stoll(count), 1LL) * 1024 * 1024;
+                }
+                catch (std::exception&)
+                {
+                    Log("Invalid " + flag.substr(1) + " value: " + count + "\n", LogType::Error);
+                }
+            }
+            else if (std::string(argv[i]) == "-timereport")
+            {
+                CLFlags.set(CLArgument::ReportTime);
+            }
+            else if (std::string(argv[i]) == "-watch")
+            {
+                CLFlags.set(CLArgument::WatchMode);
+            }
+            else if (std::string(argv[i]) == "-killonfailure")
+            {
+                KillOnFailure = true;
+            }
+            else if ((std::string(argv[i]) == "-k" && i + 1 < argc) || (std::string(argv[i]).substr(0, 2) == "-k" && std::isdigit(argv[i][2])))
+            {
+                std::string count = std::string(argv[i]).size() > 2 ? std::string(argv[i]).substr(2) : std::string(argv[++i]);
+                try
+                {
+                    FailureLimit = (unsigned int)std::max(std::stoi(count), 0);
+                }
+                catch (std::exception&)
+                {
+                    Log("Invalid failure limit: " + count + "\n", LogType::Error);
+                }
+            }
+            else if (std::string(argv[i]).rfind("-trace=", 0) == 0)
+            {
+                DefaultBuildTrace.file = std::filesystem::absolute(std::string(argv[i]).substr(7));
+            }
+            else if (std::string(argv[i]).rfind("-remote=", 0) == 0)
+            {
+                DefaultRemoteCompilers.workers = RemoteCompilers(std::string(argv[i]).substr(8)).workers;
+            }
+            else if ((std::string(argv[i]) == "-j" && i + 1 < argc) || (std::string(argv[i]).substr(0, 2) == "-j" && std::isdigit(argv[i][2])))
+            {
+                std::string count = std::string(argv[i]).size() > 2 ? std::string(argv[i]).substr(2) : std::string(argv[++i]);
+                try
+                {
+                    JobCount = std::max(std::stoi(count), 1);
+                }
+                catch (std::exception&)
+                {
+                    Log("Invalid job count: " + count + "\n", LogType::Error);
+                }
+            }
             else
             {
                 OtherCLArguments.push_back(argv[i]);
@@ -1103,7 +6744,11 @@ namespace nob
             (LogType)NOBPP_MINIMUM_LOG_LEVEL,
             NOBPP_SUMMARY_MODE == 1,
             (ConfigurationFile::ConfigRecompileMode)NOBPP_RECOMPILE_MODE,
-            NOBPP_INIT_SCRIPT
+            NOBPP_INIT_SCRIPT,
+            NOBPP_CACHE_DIRECTORY,
+            NOBPP_CACHE_SIZE_LIMIT,
+            NOBPP_REMOTE_CACHE_URL,
+            NOBPP_LINKER_NAME
         };
     }
 
@@ -1164,6 +6809,14 @@ namespace nob
         config.recompileMode = (ConfigurationFile::ConfigRecompileMode)std::stoi(temp);
         if (!std::getline(configFile, temp)) return config;
         config.initScript = temp;
+        if (!std::getline(configFile, temp)) return config;
+        config.cacheDirectory = temp;
+        if (!std::getline(configFile, temp)) return config;
+        config.cacheSizeLimit = std::stoi(temp);
+        if (!std::getline(configFile, temp)) return config;
+        config.remoteCacheUrl = temp;
+        if (!std::getline(configFile, temp)) return config;
+        config.linker = temp;
 
         return config;
     }
@@ -1173,11 +6826,13 @@ namespace nob
         std::ofstream fileOut(config.file);
         fileOut << config.compilerName << "\n" << config.extraCompilerDefaults << "\n" << config.extraLinkerDefaults << "\n"
         << (int)config.uiMode << "\n" << (int)config.fileDialogMode << "\n" << (int)config.minimumLogLevel << "\n"
-        << (config.IsSummaryMode ? 1 : 0) << "\n" << (int)config.recompileMode << "\n" << config.initScript << "\n";
+        << (config.IsSummaryMode ? 1 : 0) << "\n" << (int)config.recompileMode << "\n" << config.initScript << "\n"
+        << config.cacheDirectory << "\n" << config.cacheSizeLimit << "\n" << config.remoteCacheUrl << "\n" << config.linker << "\n";
     }
 
     int AskMultipleChoiceQuestion(std::string question, std::string info, std::vector<std::string> answers, int defaultVal)
     {
+        FlushLog();
         std::cout << question << "\n";
         for (int i = 0; i < answers.size(); i++)
         {
@@ -1216,19 +6871,19 @@ namespace nob
 
     std::string AskShortAnswerQuestion(std::string question)
     {
+        FlushLog();
         std::cout << question << "\n> ";
         std::string ret; std::getline(std::cin, ret);
         return ret;
     }
 
-    CompileCommand ConfigurationFile::GetCommand(SourceFile sf, ExecutableFile ef)
+    CompileCommand ConfigurationFile::GetBaseCommand()
     {
         CompileCommand ret;
         ret.text = compilerName + ret.text.substr(ret.text.find(' '));
-        ret = ret + std::string(extraCompilerDefaults);
-        ret = ret + CompilerFlag::CPPVersion17;
-        ret = ret + sf;
-        ret = ret
+        ret += std::string(extraCompilerDefaults);
+        ret += CompilerFlag::CPPVersion17;
+        return ret
         + MacroDefinition{ "NOBPP_CONFIGURED", file.string() }
         + MacroDefinition{ "NOBPP_COMPILER_NAME", compilerName }
         + MacroDefinition{ "NOBPP_EXTRA_DEFAULT_COMPILER_ARGS", extraCompilerDefaults }
@@ -1238,7 +6893,23 @@ namespace nob
         + MacroDefinition{ "NOBPP_MINIMUM_LOG_LEVEL", (int)minimumLogLevel }
         + MacroDefinition{ "NOBPP_SUMMARY_MODE", IsSummaryMode ? 1 : 0 }
         + MacroDefinition{ "NOBPP_RECOMPILE_MODE", (int)recompileMode }
-        + MacroDefinition{ "NOBPP_INIT_SCRIPT", initScript };
+        + MacroDefinition{ "NOBPP_INIT_SCRIPT", initScript }
+        + MacroDefinition{ "NOBPP_CACHE_DIRECTORY", cacheDirectory }
+        + MacroDefinition{ "NOBPP_CACHE_SIZE_LIMIT", cacheSizeLimit }
+        + MacroDefinition{ "NOBPP_REMOTE_CACHE_URL", remoteCacheUrl }
+        + MacroDefinition{ "NOBPP_LINKER_NAME", linker };
+    }
+
+    CompileCommand ConfigurationFile::GetCommand(SourceFile sf, ExecutableFile ef, std::filesystem::path prebuiltImplementation)
+    {
+        CompileCommand ret = GetBaseCommand() + sf;
+        if (prebuiltImplementation != "")
+        {
+            // passed to the compiler driver as an input, so it reaches the linker on every compiler
+            ret.UpdateInputTime(prebuiltImplementation);
+            ret += std::string("-DNOBPP_PREBUILT_IMPLEMENTATION");
+            ret += prebuiltImplementation;
+        }
 
         LinkCommand linkRet = LinkCommand{} + extraLinkerDefaults + ef;
 
@@ -1250,7 +6921,7 @@ namespace nob
         #endif  // TODO: implement linux and macos support here
 
 
-        ret = ret + AddLinkCommand{ linkRet };
+        ret += AddLinkCommand{ linkRet };
         return ret;
     }
 
@@ -1258,7 +6929,7 @@ namespace nob
     {
         ConfigurationFile ret;
         int out;
-        for (int i = 0; i < 11; i++)
+        for (int i = 0; i < 13; i++)
         {
             switch (i)
             {
@@ -1374,6 +7045,41 @@ namespace nob
                 }
                 break;
             case 10:
+                out = AskMultipleChoiceQuestion("Do you want to use an object cache?", "The object cache keeps a copy of every object file, keyed by a hash of the preprocessed source, the compile command and the compiler. When the same translation unit is compiled again (for example on another branch, or after a fresh checkout), the object is restored instead of compiled. Old objects are removed once the cache is over its size limit.", { "Yes", "No" }, 1);
+                if (out == 0)
+                {
+                    ret.cacheDirectory = AskShortAnswerQuestion("Enter the cache directory.");
+                    std::string limit = AskShortAnswerQuestion("Enter the cache size limit in megabytes (default 5120).");
+                    ret.cacheSizeLimit = limit == "" || !std::isdigit(limit[0]) ? 5120 : std::stoi(limit);
+                    ret.remoteCacheUrl = AskShortAnswerQuestion("Enter the URL of a shared HTTP cache (http://host:port/path), or leave this empty.");
+                }
+                else if (out == 1)
+                {
+                    ret.cacheDirectory = "";
+                    ret.remoteCacheUrl = "";
+                }
+                break;
+            case 11:
+            {
+                // only the linkers that are installed are offered
+                std::vector<std::string> linkers;
+                for (std::string name : {
+                #if defined(__nob_msvc__)
+                    "lld"
+                #else
+                    "mold", "lld", "gold"
+                #endif
+                    })
+                {
+                    if (LinkerAvailable(name)) linkers.push_back(name);
+                }
+                std::vector<std::string> answers = { "Default" };
+                answers.insert(answers.end(), linkers.begin(), linkers.end());
+                out = AskMultipleChoiceQuestion("Which linker should be used?", "Linking is the last step of every build and runs on its own, so a faster linker shortens every incremental build. mold and lld are usually several times faster than the default GNU ld or link.exe. Only the linkers found on PATH are listed.", answers, 0);
+                if (out >= 0) ret.linker = out == 0 ? "" : linkers[out - 1];
+                break;
+            }
+            case 12:
                 out = AskMultipleChoiceQuestion("Configuration complete! What do you want to do with it?", "You can still edit it by typing 'back'.", { "Save and Run", "Just Run", "Just Save" }, 0);
                 if (out == 0 || out == 2)
                 {
@@ -1426,7 +7132,7 @@ namespace nob
                     }
                 }
 
-                if (out == 0 || out == 2) std::cout << "Configuration saved.\n";
+                if (out == 0 || out == 2) Log("Configuration saved.\n", LogType::Info);
 
                 if (out == 2)
                 {
@@ -1448,6 +7154,75 @@ namespace nob
         std::filesystem::rename(file, file.parent_path() / name);
     }
 
+    namespace
+    {
+        const char* const ImplementationHeader = __FILE__;
+        std::filesystem::path ScriptPath;  // set by Init, for Watch to rebuild the script
+        std::vector<std::string> LaunchArguments;
+
+        // A self-rebuild compiles the build script against an object holding this implementation, so editing
+        // the script does not recompile all of nobpp. The object is keyed by this header, the configuration, and
+        // any NOBPP_ macros the script defines before including it. If it cannot be built, the script is
+        // compiled on its own as before.
+        CompileCommand RebuildCommand(ConfigurationFile& config, std::filesystem::path srcPath, std::filesystem::path newExec)
+        {
+            CompileCommand fallback = config.GetCommand(SourceFile{ srcPath }, ExecutableFile{ newExec });
+
+            // __FILE__ is relative to wherever the first compile ran
+            std::filesystem::path header = ImplementationHeader;
+            std::error_code ec;
+            for (std::filesystem::path candidate : { header, srcPath.parent_path() / header, std::filesystem::current_path() / header })
+            {
+                if (std::filesystem::is_regular_file(candidate, ec))
+                {
+                    header = std::filesystem::absolute(candidate).lexically_normal();
+                    break;
+                }
+            }
+            std::ifstream headerStream(header, std::ios::binary);
+            if (!header.is_absolute() || !headerStream) return fallback;
+            std::string headerContent((std::istreambuf_iterator<char>(headerStream)), std::istreambuf_iterator<char>());
+
+            std::string source = "// generated by nobpp: the implementation " + srcPath.filename().string() + " is linked against\n";
+            std::ifstream script(srcPath);
+            std::string line;
+            while (std::getline(script, line))
+            {
+                line.erase(0, line.find_first_not_of(" \t"));
+                if (line.rfind("#include", 0) == 0 && line.find(header.filename().string()) != std::string::npos) break;
+                if (line.rfind("#define NOBPP_", 0) == 0 && line.rfind("#define NOBPP_IMPLEMENTATION", 0) != 0) source += line + "\n";
+            }
+            source += "#define NOBPP_IMPLEMENTATION\n#include \"" + header.generic_string() + "\"\n";
+
+            CompileCommand base = config.GetBaseCommand();
+            char name[17];
+            std::snprintf(name, sizeof(name), "%016llx", (unsigned long long)HashString(base.text + "\n" + source + headerContent));
+            std::filesystem::path directory = ThisExecutablePath.parent_path() / ".nobpp";
+            std::string prefix = srcPath.stem().string() + "-nobpp-";
+            std::filesystem::path object = directory / (prefix + name + ".obj");
+
+            if (!std::filesystem::is_regular_file(object, ec))
+            {
+                std::filesystem::create_directories(directory, ec);
+                for (const std::filesystem::path& old : std::filesystem::directory_iterator(directory, ec))
+                {
+                    if (old.filename().string().rfind(prefix, 0) == 0) std::filesystem::remove(old, ec);
+                }
+
+                std::filesystem::path implementation = std::filesystem::path(object).replace_extension(".cpp");
+                std::ofstream(implementation, std::ios::binary) << source;
+                Log("Building the nobpp implementation (only needed once per configuration).\n", LogType::Info);
+                if ((base + SourceFile{ implementation } + ObjectFile{ object }).Run(false, true) != 0)
+                {
+                    std::filesystem::remove(object, ec);
+                    return fallback;
+                }
+            }
+
+            return config.GetCommand(SourceFile{ srcPath }, ExecutableFile{ newExec }, object);
+        }
+    }
+
     Init::Init(int argc, char** argv, std::string srcName)
     {
         if (argc < 1)
@@ -1460,19 +7235,22 @@ namespace nob
         CLFlags.reset();
         OtherCLArguments.clear();
         ConsumeFlags(argc, argv);
+        Jobs();  // joins make's jobserver, or exports our own before any child starts
         bool isActuallyClean = CLFlags[CLArgument::Clean];
         CLFlags.set(CLArgument::Clean);
 
         // get relevant files
         std::filesystem::path srcPath = ThisExecutablePath.parent_path() / srcName;
+        ScriptPath = srcPath;
+        LaunchArguments.assign(argv + 1, argv + argc);
         if (!std::filesystem::is_regular_file(srcPath))
         {
-            std::cout << "Source file not found. If you want " << srcName << " to be automatically recompiled when changed, it should be placed in the same folder as this executable.\n";
+            Log("Source file not found. If you want " + srcName + " to be automatically recompiled when changed, it should be placed in the same folder as this executable.\n", LogType::Info);
         }
 
         if (!std::filesystem::is_regular_file(ThisExecutablePath))
         {
-            std::cout << "Executable file not found (for some reason). This may cause issues.\n";
+            Log("Executable file not found (for some reason). This may cause issues.\n", LogType::Info);
         }
         else if (ThisExecutablePath.filename().string() != (srcPath.stem().string()  // if new, rename
       #ifdef _WIN32
@@ -1500,9 +7278,9 @@ namespace nob
         if (CLFlags[CLArgument::Configure])
         {
             ConfigurationFile config = GenerateConfigFile();
-            std::cout << "Rebuilding with configuration.\n";
+            Log("Rebuilding with configuration.\n", LogType::Info);
             std::filesystem::path newExec = ThisExecutablePath.parent_path() / (ThisExecutablePath.stem().string() + ".new" + ThisExecutablePath.extension().string());
-            Command newBinCmd = (config.GetCommand(SourceFile{ srcPath }, ExecutableFile{ newExec })) + (AddArgs(Command() + newExec, argc, argv) + std::string("-noinitscript") + std::string("-norebuild"));
+            Command newBinCmd = RebuildCommand(config, srcPath, newExec) + (AddArgs(Command() + newExec, argc, argv) + std::string("-noinitscript") + std::string("-norebuild"));
             if (!CLFlags[CLArgument::NoInitScript] && config.initScript != "")
             {
                 newBinCmd = (Command() + std::filesystem::path{ config.initScript }) + newBinCmd;
@@ -1536,9 +7314,9 @@ namespace nob
         if (shouldRebuild)
         {
             ConfigurationFile config = ConfigurationFile::GetDefaultConfig();
-            std::cout << "Rebuilding.\n";
+            Log("Rebuilding.\n", LogType::Info);
             std::filesystem::path newExec = ThisExecutablePath.parent_path() / (ThisExecutablePath.stem().string() + ".new" + ThisExecutablePath.extension().string());
-            Command newBinCmd = (config.GetCommand(SourceFile{ srcPath }, ExecutableFile{ newExec })) + (AddArgs(Command() + newExec, argc, argv) + std::string("-noinitscript") + std::string("-norebuild"));
+            Command newBinCmd = RebuildCommand(config, srcPath, newExec) + (AddArgs(Command() + newExec, argc, argv) + std::string("-noinitscript") + std::string("-norebuild"));
             if (shouldInitScript)
             {
                 newBinCmd = (Command() + std::filesystem::path{ config.initScript }) + newBinCmd;
@@ -1558,17 +7336,17 @@ namespace nob
         std::filesystem::path configPath;
         if (!CLFlags[CLArgument::Configure] && FindConfigFile(configPath))
         {
-            std::cout << "Configuration found. Rerun with -configure to create a new configuration.\n";
+            Log("Configuration found. Rerun with -configure to create a new configuration.\n", LogType::Info);
             config = LoadConfigFile(configPath);
         }
         else
         {
-            if (!CLFlags[CLArgument::Configure]) std::cout << "No configuration found.\n";
+            if (!CLFlags[CLArgument::Configure]) Log("No configuration found.\n", LogType::Info);
             config = GenerateConfigFile();
         }
-        std::cout << "Rebuilding with configuration.\n";
+        Log("Rebuilding with configuration.\n", LogType::Info);
         std::filesystem::path newExec = ThisExecutablePath.parent_path() / (ThisExecutablePath.stem().string() + ".new" + ThisExecutablePath.extension().string());
-        Command newBinCmd = (config.GetCommand(SourceFile{ srcPath }, ExecutableFile{ newExec })) + (AddArgs(Command() + newExec, argc, argv) + std::string("-noinitscript") + std::string("-norebuild"));
+        Command newBinCmd = RebuildCommand(config, srcPath, newExec) + (AddArgs(Command() + newExec, argc, argv) + std::string("-noinitscript") + std::string("-norebuild"));
         if (config.initScript != "")
         {
             newBinCmd = (Command() + std::filesystem::path{ config.initScript }) + newBinCmd;
@@ -1581,57 +7359,378 @@ namespace nob
 
         if (CLFlags[CLArgument::Debug])
         {
-            DefaultCompileCommand = DefaultCompileCommand + CompilerFlag::Debug;
-            DefaultLinkCommand = DefaultLinkCommand + LinkerFlag::Debug;
+            // the objects and the link get the same kind of debug info
+            switch (DebugInfoMode)
+            {
+            case DebugInfo::Full:
+                DefaultCompileCommand = DefaultCompileCommand + CompilerFlag::Debug;
+                DefaultLinkCommand = DefaultLinkCommand + LinkerFlag::Debug;
+                break;
+            case DebugInfo::Split:
+                DefaultCompileCommand = DefaultCompileCommand + CompilerFlag::DebugSplit;
+                DefaultLinkCommand = DefaultLinkCommand + LinkerFlag::DebugSplit;
+                break;
+            case DebugInfo::Compressed:
+                DefaultCompileCommand = DefaultCompileCommand + CompilerFlag::DebugCompressed;
+                DefaultLinkCommand = DefaultLinkCommand + LinkerFlag::DebugCompressed;
+                break;
+            }
         }
     }
 
     Init::~Init()
     {
-        // std::filesystem::remove(std::filesystem::temp_directory_path() / "nob_error_log.txt");
+        DefaultObjectCache.FinishUploads();
+        DefaultObjectCache.Trim();
+        DefaultBuildTrace.Write();
+        DefaultTimeReport.Write();
     }
 
-    void Log(std::string s, LogType t)
+    namespace
     {
-        std::string prefix = t == LogType::Info ? "[INFO] " : (t == LogType::Run ? "[RUN]  " : "");
+        // Waits for files under a set of directories (and one other file) to change: with inotify on Linux,
+        // ReadDirectoryChangesW on Windows, and by comparing write times four times a second elsewhere
+        class FileWatcher
+        {
+        public:
+            FileWatcher(const std::vector<std::filesystem::path>& directories, const std::filesystem::path& file)
+            {
+            #if defined(__linux__)
+                fd = inotify_init1(IN_CLOEXEC);
+                for (const std::filesystem::path& directory : directories)
+                {
+                    Add(directory, "");
+                }
+                if (file != "") Add(file.parent_path(), file.filename().string());
+            #elif defined(_WIN32)
+                for (const std::filesystem::path& directory : directories)
+                {
+                    Add(directory, "");
+                }
+                if (file != "") Add(file.parent_path(), file.filename().string());
+            #else
+                roots = directories;
+                single = file;
+                times = Snapshot();
+            #endif
+            }
 
-#ifdef NOBPP_CUSTOM_LOG
-        NOBPP_CUSTOM_LOG((prefix + s));
-#else
+            ~FileWatcher()
+            {
+            #if defined(__linux__)
+                if (fd >= 0) close(fd);
+            #elif defined(_WIN32)
+                for (Watched& watched : watches)
+                {
+                    CancelIo(watched.handle);
+                    CloseHandle(watched.handle);
+                    CloseHandle(watched.overlapped.hEvent);
+                }
+            #endif
+            }
+
+            // returns what changed, once nothing more has changed for a moment (saving often writes a file more than once)
+            std::vector<std::filesystem::path> Wait()
+            {
+                std::vector<std::filesystem::path> changed;
+            #if defined(__linux__)
+                alignas(inotify_event) char buffer[16384];
+                int timeout = -1;
+                while (fd >= 0)
+                {
+                    pollfd p = { fd, POLLIN, 0 };
+                    int ready = poll(&p, 1, timeout);
+                    if (ready < 0 && errno == EINTR) continue;
+                    if (ready <= 0) break;
+
+                    ssize_t count = read(fd, buffer, sizeof(buffer));
+                    if (count <= 0) break;
+                    for (char* at = buffer; at < buffer + count; )
+                    {
+                        inotify_event* event = (inotify_event*)at;
+                        at += sizeof(inotify_event) + event->len;
+
+                        auto it = watches.find(event->wd);
+                        if (it == watches.end() || event->len == 0) continue;
+                        std::string name = event->name;
+                        if (it->second.second != "" && name != it->second.second) continue;
+
+                        std::filesystem::path path = it->second.first / name;
+                        if ((event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO)))
+                        {
+                            Add(path, "");  // inotify does not watch subdirectories on its own
+                        }
+                        if (!WrittenByBuild(path)) changed.push_back(path);
+                    }
+                    if (!changed.empty()) timeout = 50;
+                }
+            #elif defined(_WIN32)
+                std::vector<HANDLE> events;
+                for (Watched& watched : watches) events.push_back(watched.overlapped.hEvent);
+                DWORD timeout = INFINITE;
+                while (!events.empty())
+                {
+                    DWORD ready = WaitForMultipleObjects((DWORD)events.size(), events.data(), FALSE, timeout);
+                    if (ready < WAIT_OBJECT_0 || ready >= WAIT_OBJECT_0 + events.size()) break;
+
+                    Watched& watched = watches[ready - WAIT_OBJECT_0];
+                    DWORD count = 0;
+                    if (GetOverlappedResult(watched.handle, &watched.overlapped, &count, FALSE))
+                    {
+                        if (count == 0 && watched.only == "")
+                        {
+                            changed.push_back(watched.directory);  // the buffer overflowed, so anything may have changed
+                        }
+                        for (DWORD offset = 0; count != 0; )
+                        {
+                            FILE_NOTIFY_INFORMATION* info = (FILE_NOTIFY_INFORMATION*)((char*)watched.buffer.data() + offset);
+                            std::filesystem::path path = watched.directory / std::wstring(info->FileName, info->FileNameLength / sizeof(WCHAR));
+                            if ((watched.only == "" || path.filename().string() == watched.only) && !WrittenByBuild(path)) changed.push_back(path);
+                            if (info->NextEntryOffset == 0) break;
+                            offset += info->NextEntryOffset;
+                        }
+                    }
+                    Listen(watched);
+                    if (!changed.empty()) timeout = 50;
+                }
+            #else
+                while (changed.empty())
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(250));
+                    std::unordered_map<std::string, int64_t> now = Snapshot();
+                    for (auto& [file, time] : now)
+                    {
+                        auto it = times.find(file);
+                        if ((it == times.end() || it->second != time) && !WrittenByBuild(file)) changed.push_back(file);
+                    }
+                    for (auto& [file, time] : times)
+                    {
+                        if (now.find(file) == now.end() && !WrittenByBuild(file)) changed.push_back(file);
+                    }
+                    times = std::move(now);
+                }
+            #endif
+                std::sort(changed.begin(), changed.end());
+                changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+                return changed;
+            }
+
+        private:
+            // what nobpp writes itself, which would otherwise start another build every time it is written
+            static bool WrittenByBuild(const std::filesystem::path& file)
+            {
+                std::error_code ec;
+                std::filesystem::path path = std::filesystem::absolute(file, ec).lexically_normal();
+                BuildRecord record;
+                if (DefaultBuildLog.Find(path, record)) return true;  // a command's output (and loads the log, which sets its file)
+                if ((path.extension() == ".d" || path.extension() == ".json") && DefaultBuildLog.Find(std::filesystem::path(path).replace_extension(".obj"), record))
+                {
+                    return true;  // the dependency file or time trace next to an object
+                }
+                std::string name = path.filename().string();
+                if (name == "objects.list" || name == "modules.scan" || name == "unity_isolated.txt" || name == ".nobppprobe") return true;
+
+                std::filesystem::path report = DefaultTimeReport.file != "" ? DefaultTimeReport.file : ThisExecutablePath.parent_path() / "time-report.txt";
+                for (const std::filesystem::path& own : { DefaultBuildLog.file, DefaultBuildTrace.file, report })
+                {
+                    if (own != "" && std::filesystem::absolute(own, ec).lexically_normal() == path) return true;
+                }
+                return false;
+            }
+
+        #if defined(__linux__)
+            void Add(const std::filesystem::path& directory, const std::string& only)
+            {
+                const uint32_t mask = IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO;
+                int wd = inotify_add_watch(fd, directory.string().c_str(), mask);
+                if (wd < 0) return;
+                if (watches.find(wd) != watches.end() && only != "") return;  // already watched for every file
+                watches[wd] = { directory, only };
+                if (only != "") return;
+
+                std::error_code ec;
+                for (auto it = std::filesystem::recursive_directory_iterator(directory, std::filesystem::directory_options::skip_permission_denied, ec);
+                     it != std::filesystem::recursive_directory_iterator(); it.increment(ec))
+                {
+                    if (it->is_directory(ec))
+                    {
+                        int sub = inotify_add_watch(fd, it->path().string().c_str(), mask);
+                        if (sub >= 0) watches[sub] = { it->path(), "" };
+                    }
+                }
+            }
+
+            int fd = -1;
+            std::unordered_map<int, std::pair<std::filesystem::path, std::string>> watches;  // directory, and the only file in it that counts
+        #elif defined(_WIN32)
+            struct Watched
+            {
+                std::filesystem::path directory;
+                std::string only;
+                HANDLE handle = INVALID_HANDLE_VALUE;
+                OVERLAPPED overlapped = {};
+                std::vector<DWORD> buffer = std::vector<DWORD>(16384);  // DWORD aligned, as ReadDirectoryChangesW needs
+            };
+
+            void Add(const std::filesystem::path& directory, const std::string& only)
+            {
+                Watched watched;
+                watched.directory = directory;
+                watched.only = only;
+                watched.handle = CreateFileW(directory.wstring().c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                    NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+                if (watched.handle == INVALID_HANDLE_VALUE) return;
+                watched.overlapped.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+                watches.push_back(std::move(watched));
+                Listen(watches.back());
+            }
+
+            void Listen(Watched& watched)
+            {
+                ResetEvent(watched.overlapped.hEvent);
+                ReadDirectoryChangesW(watched.handle, watched.buffer.data(), (DWORD)(watched.buffer.size() * sizeof(DWORD)), watched.only == "",
+                    FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE,
+                    NULL, &watched.overlapped, NULL);
+            }
+
+            std::deque<Watched> watches;  // a deque, so the OVERLAPPED the kernel writes to never moves
+        #else
+            std::unordered_map<std::string, int64_t> Snapshot()
+            {
+                std::unordered_map<std::string, int64_t> ret;
+                std::error_code ec;
+                for (const std::filesystem::path& root : roots)
+                {
+                    for (auto it = std::filesystem::recursive_directory_iterator(root, std::filesystem::directory_options::skip_permission_denied, ec);
+                         it != std::filesystem::recursive_directory_iterator(); it.increment(ec))
+                    {
+                        // read directly, since the file time cache would hide the changes this looks for
+                        if (it->is_regular_file(ec)) ret[it->path().string()] = it->last_write_time(ec).time_since_epoch().count();
+                    }
+                }
+                if (single != "")
+                {
+                    std::filesystem::file_time_type time = std::filesystem::last_write_time(single, ec);
+                    ret[single.string()] = ec ? INT64_MIN : (int64_t)time.time_since_epoch().count();
+                }
+                return ret;
+            }
 
-#if NOBPP_UI_MODE == 1 && defined(_WIN32)
-        HANDLE console = GetStdHandle(STD_OUTPUT_HANDLE);
+            std::vector<std::filesystem::path> roots;
+            std::filesystem::path single;
+            std::unordered_map<std::string, int64_t> times;
+        #endif
+        };
+    }
 
-        int consoleCode = 15;
-        switch (t)
+    void Watch(std::vector<std::filesystem::path> directories, std::function<void()> build)
+    {
+        build();
+        if (!CLFlags[CLArgument::WatchMode]) return;
+        CLFlags.reset(CLArgument::Clean);  // only the first build is clean
+
+        std::error_code ec;
+        std::filesystem::path script = ScriptPath == "" ? "" : std::filesystem::absolute(ScriptPath, ec).lexically_normal();
+        FileWatcher watcher(directories, script);
+        uint64_t written = 0;
+        while (true)
         {
-        case LogType::Info: consoleCode = 3; break;
-        case LogType::Run: consoleCode = 8; break;
-        case LogType::Error: consoleCode = 4; break;
-        default:
-            break;
+            // the process is usually stopped with Ctrl+C, so nothing can wait for ~Init
+            if (CommandsRun != written)
+            {
+                written = CommandsRun;
+                DefaultObjectCache.FinishUploads();
+                DefaultObjectCache.Trim();
+                DefaultBuildTrace.Write();
+                DefaultTimeReport.Write();
+            }
+            Log("Watching for changes (Ctrl+C to stop).\n", LogType::Info);
+
+            std::vector<std::filesystem::path> changed = watcher.Wait();
+            if (changed.empty()) continue;
+
+            bool scriptChanged = std::any_of(changed.begin(), changed.end(),
+                [&](const std::filesystem::path& file) { return std::filesystem::absolute(file, ec).lexically_normal() == script; });
+            if (scriptChanged && NOBPP_RECOMPILE_MODE != 2)
+            {
+                ConfigurationFile config = ConfigurationFile::GetDefaultConfig();
+            #ifndef NOBPP_CONFIGURED
+                std::filesystem::path configPath;
+                if (FindConfigFile(configPath)) config = LoadConfigFile(configPath);
+            #endif
+                Log(script.filename().string() + " changed, rebuilding it.\n", LogType::Info);
+                std::filesystem::path newExec = ThisExecutablePath.parent_path() / (ThisExecutablePath.stem().string() + ".new" + ThisExecutablePath.extension().string());
+                bool clean = CLFlags[CLArgument::Clean];
+                CLFlags.set(CLArgument::Clean);
+                int result = RebuildCommand(config, script, newExec).Run(false, true);
+                CLFlags.set(CLArgument::Clean, clean);
+
+                if (result == 0)
+                {
+                    std::vector<std::string> args = { newExec.string() };
+                    args.insert(args.end(), LaunchArguments.begin(), LaunchArguments.end());
+                    args.push_back("-noinitscript");
+                    args.push_back("-norebuild");
+                #ifdef _WIN32
+                    std::exit(RunProcess(args, std::filesystem::current_path(), true).exitCode);
+                #else
+                    std::vector<char*> argv;
+                    for (std::string& arg : args) argv.push_back(arg.data());
+                    argv.push_back(nullptr);
+                    FlushLog();
+                    execv(argv[0], argv.data());
+                    Log("Could not start " + args[0] + ": " + std::string(std::strerror(errno)) + "\n", LogType::Error);
+                #endif
+                }
+                Log("Still watching with the previous build script.\n", LogType::Info);
+            }
+
+            Log(changed[0].string() + (changed.size() > 1 ? " and " + std::to_string(changed.size() - 1) + " more changed.\n" : " changed.\n"), LogType::Info);
+            DefaultObjectCache.ForgetKeys();
+            for (const std::filesystem::path& file : changed)
+            {
+                // a directory (all Windows reports when its buffer overflowed) or something removed, which may
+                // have had files under it, makes every time suspect
+                std::filesystem::file_status status = std::filesystem::status(file, ec);
+                if (!std::filesystem::exists(status) || std::filesystem::is_directory(status))
+                {
+                    ClearFileTimeCache();
+                    break;
+                }
+                InvalidateFileTime(file);
+            }
+            DefaultJobPool.ClearFailures();
+            auto start = std::chrono::steady_clock::now();
+            build();
+            Log("Rebuilt in " + std::to_string(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()) + "s.\n", LogType::Info);
         }
+    }
+
+    LogRecord::operator std::string() const
+    {
+        return (type == LogType::Info ? "[INFO] " : (type == LogType::Run ? "[RUN]  " : "")) + text;
+    }
 
-        SetConsoleTextAttribute(console, consoleCode);
-        std::cout << prefix + s;
-        SetConsoleTextAttribute(console, 15);
-#elif NOBPP_UI_MODE == 1
-        std::string consoleCode = "0";
-        switch (t)
+    void Log(std::string s, LogType t)
+    {
+        if (CurrentGroup != nullptr)
         {
-        case LogType::Info: consoleCode = "0;36"; break;
-        case LogType::Run: consoleCode = "1;30"; break;
-        case LogType::Error: consoleCode = "0;31"; break;
-        default:
-            break;
+            CurrentGroup->records.push_back({ t, std::move(s), CurrentGroup->job });
         }
+        else
+        {
+            Sink().Write({ LogRecord{ t, std::move(s), "" } });
+        }
+    }
 
-        std::cout << "\033[" + consoleCode + "m" << prefix + s << "\033[0m";
-#else
-        std::cout << prefix + s;
-#endif
-
-#endif
+    void FlushLog()
+    {
+        if (CurrentGroup != nullptr)
+        {
+            Sink().Write(std::move(CurrentGroup->records));
+            CurrentGroup->records.clear();
+        }
+        Sink().Flush();
     }
 }
 